@@ -0,0 +1,120 @@
+#include "allocations.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+#ifndef NDEBUG
+
+namespace {
+
+std::atomic<uint64_t> allocations{ 0 };
+
+void* allocate(size_t bytes) {
+    ++allocations;
+    void* p = std::malloc(bytes ? bytes : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* allocateAligned(size_t bytes, std::align_val_t alignment) {
+    ++allocations;
+    const size_t align = static_cast<size_t>(alignment);
+#ifdef _MSC_VER
+    void* p = _aligned_malloc(bytes ? bytes : 1, align);
+#else
+    void* p = std::aligned_alloc(align, (bytes ? bytes + align - 1 : align) / align * align);
+#endif
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void freeAligned(void* p) {
+#ifdef _MSC_VER
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+}
+
+uint64_t allocationCount() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+void* operator new(size_t bytes) {
+    return allocate(bytes);
+}
+
+void* operator new[](size_t bytes) {
+    return allocate(bytes);
+}
+
+void* operator new(size_t bytes, const std::nothrow_t&) noexcept {
+    try {
+        return allocate(bytes);
+    }
+    catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t bytes, const std::nothrow_t& tag) noexcept {
+    return operator new(bytes, tag);
+}
+
+void* operator new(size_t bytes, std::align_val_t alignment) {
+    return allocateAligned(bytes, alignment);
+}
+
+void* operator new[](size_t bytes, std::align_val_t alignment) {
+    return allocateAligned(bytes, alignment);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    freeAligned(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept {
+    freeAligned(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept {
+    freeAligned(p);
+}
+
+void operator delete[](void* p, size_t, std::align_val_t) noexcept {
+    freeAligned(p);
+}
+
+#else
+
+uint64_t allocationCount() {
+    return 0;
+}
+
+#endif
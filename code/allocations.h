@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+	Heap allocations made through operator new so far, process-wide: the difference over a
+	frame shows whether it touched the heap. Counted only in debug builds (no NDEBUG), which
+	replace the global operator new for it; release builds keep the default one and report 0.
+*/
+uint64_t allocationCount();
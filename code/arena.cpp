@@ -0,0 +1,40 @@
+#include "arena.h"
+
+#include <new>
+
+void FrameArena::AlignedDelete::operator()(unsigned char* p) const {
+    ::operator delete[](p, std::align_val_t{ alignment });
+}
+
+FrameArena::Block FrameArena::allocateBlock(size_t bytes) {
+    return Block(static_cast<unsigned char*>(::operator new[](bytes, std::align_val_t{ alignment })));
+}
+
+void* FrameArena::allocateBytes(size_t bytes) {
+    // Every allocation starts on a cache line, so arrays filled by different threads don't share one
+    bytes = (bytes + alignment - 1) / alignment * alignment;
+    demand += bytes;
+    if (used + bytes <= capacity) {
+        void* p = block.get() + used;
+        used += bytes;
+        return p;
+    }
+    spill.push_back(allocateBlock(bytes));
+    return spill.back().get();
+}
+
+void FrameArena::reset() {
+    if (!spill.empty()) {
+        spill.clear();
+        reserve(demand);
+    }
+    used = 0;
+    demand = 0;
+}
+
+void FrameArena::reserve(size_t bytes) {
+    if (bytes > capacity) {
+        block = allocateBlock(bytes);
+        capacity = bytes;
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+/*
+	Bump allocator for scratch arrays that live for one frame.
+	allocate() hands out cache-aligned, uninitialized storage; reset() releases all of it at once.
+	A frame that outgrows the block spills into extra blocks, and the next reset() replaces
+	them with one block of the peak size, so once warmed up a frame never reaches the heap.
+*/
+class FrameArena {
+public:
+	static constexpr size_t alignment = 64;
+
+	FrameArena() = default;
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	template <typename T>
+	T* allocate(size_t count) {
+		static_assert(std::is_trivially_destructible_v<T>, "reset() runs no destructors");
+		static_assert(alignof(T) <= alignment, "over-aligned type");
+		return static_cast<T*>(allocateBytes(count * sizeof(T)));
+	}
+
+	// Invalidates everything allocated since the last reset()
+	void reset();
+	// Between frames: grows the block to at least 'bytes' up front
+	void reserve(size_t bytes);
+	size_t getCapacity() const { return capacity; }
+
+private:
+	struct AlignedDelete {
+		void operator()(unsigned char* p) const;
+	};
+	using Block = std::unique_ptr<unsigned char[], AlignedDelete>;
+
+	Block block;
+	size_t capacity = 0;
+	size_t used = 0;
+	// Blocks for what didn't fit this frame, and the frame's total demand
+	std::vector<Block> spill;
+	size_t demand = 0;
+
+	static Block allocateBlock(size_t bytes);
+	void* allocateBytes(size_t bytes);
+};
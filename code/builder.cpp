@@ -0,0 +1,96 @@
+#include "builder.h"
+
+FjordBuilder::FjordBuilder(std::unique_ptr<HeightGenerator> generator)
+    : back{ std::make_unique<Fjord>(std::move(generator)) } {
+    back->setCancelFlag(&cancelled);
+    thread = std::thread(&FjordBuilder::buildLoop, this);
+}
+
+FjordBuilder::~FjordBuilder() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        cancelled = true;
+    }
+    wake.notify_all();
+    thread.join();
+}
+
+void FjordBuilder::request(const Settings& settings) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->settings = settings;
+        pending = true;
+        ready = false;
+        if (building) {
+            cancelled = true;
+        }
+    }
+    wake.notify_one();
+}
+
+void FjordBuilder::cancel() {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending = false;
+    ready = false;
+    if (building) {
+        cancelled = true;
+    }
+}
+
+bool FjordBuilder::takeResult(Fjord& front) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!ready) {
+        return false;
+    }
+    // Nothing builds while a result is ready, so back is ours until a new request
+    ready = false;
+    front.swapMap(*back);
+    return true;
+}
+
+bool FjordBuilder::isBusy() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pending || building || ready;
+}
+
+void FjordBuilder::setCacheDirectory(const std::string& directory) {
+    std::lock_guard<std::mutex> lock(mutex);
+    cacheDirectory = directory;
+    cacheDirectoryChanged = true;
+}
+
+void FjordBuilder::buildLoop() {
+    for (;;) {
+        Settings job;
+        std::string directory;
+        bool directoryChanged = false;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || pending; });
+            if (stopping) {
+                return;
+            }
+            job = settings;
+            pending = false;
+            building = true;
+            cancelled = false;
+            directory = cacheDirectory;
+            directoryChanged = cacheDirectoryChanged;
+            cacheDirectoryChanged = false;
+        }
+
+        // Only this thread touches back while building
+        if (directoryChanged) {
+            back->setCacheDirectory(directory);
+        }
+        back->setQuantized(job.quantized);
+        back->update(true, job.octave, job.seed, job.maxElevation, job.tileSize, job.isLake, job.waterPercentage);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            building = false;
+            ready = !cancelled && !pending;
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "fjord.h"
+#include "generator.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/*
+	Builds maps on a background thread into a back buffer Fjord nobody else sees.
+	Each request() replaces the pending one and cancels the build in progress, so a burst
+	of requests (a dragged slider) only pays for the last. takeResult() hands a finished
+	map over by swapping it with the caller's Fjord, whose old map becomes the next back buffer.
+*/
+class FjordBuilder {
+public:
+	// Fjord::update() arguments and storage mode; builds always reseed, the back buffer's offsets may be stale
+	struct Settings {
+		int octave = 8;
+		int seed = 0;
+		int maxElevation = 3000;
+		int tileSize = 20;
+		bool isLake = false;
+		float waterPercentage = 0.5f;
+		// See Fjord::setQuantized()
+		bool quantized = false;
+	};
+
+	explicit FjordBuilder(std::unique_ptr<HeightGenerator> generator);
+	~FjordBuilder();
+	FjordBuilder(const FjordBuilder&) = delete;
+	FjordBuilder& operator=(const FjordBuilder&) = delete;
+
+	void request(const Settings& settings);
+	// Drops the pending request, the build in progress and any result not taken yet
+	void cancel();
+	/*
+		If the latest request finished building, swaps its map into 'front' (see Fjord::swapMap())
+		and returns true. Call from the thread that owns 'front'.
+	*/
+	bool takeResult(Fjord& front);
+	// True from request() until its result is taken or cancelled
+	bool isBusy() const;
+	// Applies from the next build on
+	void setCacheDirectory(const std::string& directory);
+
+private:
+	std::unique_ptr<Fjord> back;
+
+	mutable std::mutex mutex;
+	std::condition_variable wake;
+	Settings settings;
+	std::string cacheDirectory;
+	bool cacheDirectoryChanged = false;
+	bool pending = false;
+	bool building = false;
+	bool ready = false;
+	bool stopping = false;
+	// Set to abandon the build in progress; polled by back's generator workers
+	std::atomic<bool> cancelled{ false };
+	std::thread thread;
+
+	void buildLoop();
+};
@@ -0,0 +1,209 @@
+#include "deflate.h"
+
+#include <algorithm>
+#include <array>
+
+namespace {
+
+const uint16_t lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const uint8_t lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+const uint16_t distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+const uint8_t distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+constexpr size_t windowSize = 32768;
+constexpr size_t minMatch = 3;
+constexpr size_t maxMatch = 258;
+constexpr int hashBits = 15;
+constexpr int maxChain = 16;
+
+// Deflate packs bits LSB first; Huffman codes go in MSB first
+class BitWriter {
+private:
+    std::vector<uint8_t>& out;
+    uint64_t bits = 0;
+    int count = 0;
+
+public:
+    explicit BitWriter(std::vector<uint8_t>& out) : out{ out } {}
+
+    void put(uint32_t value, int length) {
+        bits |= static_cast<uint64_t>(value) << count;
+        count += length;
+        while (count >= 8) {
+            out.push_back(static_cast<uint8_t>(bits));
+            bits >>= 8;
+            count -= 8;
+        }
+    }
+
+    void putCode(uint32_t code, int length) {
+        uint32_t reversed = 0;
+        for (int i = 0; i < length; ++i) {
+            reversed = (reversed << 1) | ((code >> i) & 1);
+        }
+        put(reversed, length);
+    }
+
+    void align() {
+        if (count > 0) {
+            put(0, 8 - count);
+        }
+    }
+};
+
+void putLiteral(BitWriter& writer, int symbol) {
+    if (symbol < 144) {
+        writer.putCode(0x30 + symbol, 8);
+    }
+    else if (symbol < 256) {
+        writer.putCode(0x190 + symbol - 144, 9);
+    }
+    else if (symbol < 280) {
+        writer.putCode(symbol - 256, 7);
+    }
+    else {
+        writer.putCode(0xC0 + symbol - 280, 8);
+    }
+}
+
+void putMatch(BitWriter& writer, size_t length, size_t distance) {
+    int l = 28;
+    while (lengthBase[l] > length) {
+        --l;
+    }
+    putLiteral(writer, 257 + l);
+    writer.put(static_cast<uint32_t>(length - lengthBase[l]), lengthExtra[l]);
+
+    int d = 29;
+    while (distanceBase[d] > distance) {
+        --d;
+    }
+    writer.putCode(d, 5);
+    writer.put(static_cast<uint32_t>(distance - distanceBase[d]), distanceExtra[d]);
+}
+
+uint32_t hash3(const uint8_t* p) {
+    return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & ((1u << hashBits) - 1);
+}
+
+}
+
+void deflateSegment(const uint8_t* data, size_t size, bool final, std::vector<uint8_t>& out) {
+    BitWriter writer(out);
+    writer.put(final ? 1 : 0, 1);
+    writer.put(1, 2); // fixed Huffman codes
+
+    // Hash chains over positions; prev is indexed modulo the window
+    std::vector<int64_t> head(size_t(1) << hashBits, -1);
+    std::vector<int64_t> prev(windowSize, -1);
+    auto insert = [&](size_t pos) {
+        const uint32_t h = hash3(data + pos);
+        prev[pos % windowSize] = head[h];
+        head[h] = static_cast<int64_t>(pos);
+    };
+
+    size_t pos = 0;
+    while (pos < size) {
+        size_t bestLength = 0;
+        size_t bestDistance = 0;
+        if (pos + minMatch <= size) {
+            const size_t limit = std::min(maxMatch, size - pos);
+            int64_t candidate = head[hash3(data + pos)];
+            for (int chain = 0; chain < maxChain && candidate >= 0 && pos - candidate <= windowSize; ++chain) {
+                const uint8_t* a = data + candidate;
+                const uint8_t* b = data + pos;
+                size_t length = 0;
+                while (length < limit && a[length] == b[length]) {
+                    ++length;
+                }
+                if (length > bestLength) {
+                    bestLength = length;
+                    bestDistance = pos - static_cast<size_t>(candidate);
+                    if (length == limit) {
+                        break;
+                    }
+                }
+                candidate = prev[candidate % windowSize];
+            }
+        }
+
+        if (bestLength >= minMatch) {
+            putMatch(writer, bestLength, bestDistance);
+            for (size_t k = 0; k < bestLength; ++k, ++pos) {
+                if (pos + minMatch <= size) {
+                    insert(pos);
+                }
+            }
+        }
+        else {
+            putLiteral(writer, data[pos]);
+            if (pos + minMatch <= size) {
+                insert(pos);
+            }
+            ++pos;
+        }
+    }
+    putLiteral(writer, 256);
+
+    if (!final) {
+        // Empty stored block: byte-aligns the segment (a sync flush)
+        writer.put(0, 1);
+        writer.put(0, 2);
+        writer.align();
+        out.insert(out.end(), { 0x00, 0x00, 0xFF, 0xFF });
+    }
+    else {
+        writer.align();
+    }
+}
+
+uint32_t adler32(uint32_t adler, const uint8_t* data, size_t size) {
+    constexpr uint32_t mod = 65521;
+    uint32_t a = adler & 0xFFFF;
+    uint32_t b = adler >> 16;
+    while (size > 0) {
+        // Largest run that can't overflow 32 bits before the modulo
+        const size_t run = std::min<size_t>(size, 5552);
+        for (size_t i = 0; i < run; ++i) {
+            a += data[i];
+            b += a;
+        }
+        a %= mod;
+        b %= mod;
+        data += run;
+        size -= run;
+    }
+    return (b << 16) | a;
+}
+
+uint32_t adler32Combine(uint32_t adlerA, uint32_t adlerB, size_t sizeB) {
+    constexpr uint64_t mod = 65521;
+    const uint64_t remainder = sizeB % mod;
+    const uint64_t a1 = adlerA & 0xFFFF;
+    const uint64_t b1 = adlerA >> 16;
+    const uint64_t a2 = adlerB & 0xFFFF;
+    const uint64_t b2 = adlerB >> 16;
+    // B's sums started from a = 1, b = 0 rather than from A's
+    const uint64_t a = (a1 + a2 + mod - 1) % mod;
+    const uint64_t b = (b1 + b2 + remainder * a1 + mod - remainder) % mod;
+    return static_cast<uint32_t>((b << 16) | a);
+}
+
+uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t;
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[n] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+	Minimal zlib-compatible compression for the exporters, no external dependency.
+	deflateSegment() compresses one independent piece of a raw deflate stream (RFC 1951):
+	greedy LZ77 matching within the piece, fixed Huffman codes. A non-final piece ends
+	with an empty stored block so it stops on a byte boundary; pieces compressed on
+	different threads can then be concatenated, with the last one marked final.
+*/
+void deflateSegment(const uint8_t* data, size_t size, bool final, std::vector<uint8_t>& out);
+
+uint32_t adler32(uint32_t adler, const uint8_t* data, size_t size);
+// Adler-32 of A followed by B, from adler32(A), adler32(B) and B's length
+uint32_t adler32Combine(uint32_t adlerA, uint32_t adlerB, size_t sizeB);
+
+uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size);
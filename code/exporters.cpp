@@ -0,0 +1,331 @@
+#include "exporters.h"
+#include "deflate.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace {
+
+// Target encoded size of one strip
+constexpr size_t stripBytes = size_t(1) << 20;
+
+size_t rowsPerStrip(size_t bytesPerRow) {
+    return std::max<size_t>(1, stripBytes / std::max<size_t>(1, bytesPerRow));
+}
+
+/*
+    Splits 'rows' into strips, runs encode(strip, firstRow, rowCount, buffer) for up to
+    2 x concurrency strips at a time, then passes each buffer to write(strip, buffer) in order.
+*/
+template <typename Encode, typename Write>
+bool streamStrips(size_t rows, size_t stripRows, WorkerPool& pool, Encode encode, Write write) {
+    const size_t strips = (rows + stripRows - 1) / stripRows;
+    const size_t wave = std::max<size_t>(1, pool.getConcurrency() * 2);
+    std::vector<std::vector<uint8_t>> buffers(std::min(wave, strips));
+    for (size_t first = 0; first < strips; first += wave) {
+        const size_t count = std::min(wave, strips - first);
+        pool.parallelFor(count, [&](size_t k) {
+            const size_t strip = first + k;
+            const size_t firstRow = strip * stripRows;
+            buffers[k].clear();
+            encode(strip, firstRow, std::min(stripRows, rows - firstRow), buffers[k]);
+        });
+        for (size_t k = 0; k < count; ++k) {
+            if (!write(first + k, buffers[k])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool writeBytes(std::ofstream& out, const void* data, size_t size) {
+    return static_cast<bool>(out.write(static_cast<const char*>(data), size));
+}
+
+uint16_t quantize(float height, float low, float scale) {
+    float v = (height - low) * scale;
+    if (!(v > 0.0f)) {
+        v = 0.0f;
+    }
+    return static_cast<uint16_t>(std::min(v, 65535.0f) + 0.5f);
+}
+
+float quantizeScale(float low, float high) {
+    return high > low ? 65535.0f / (high - low) : 0.0f;
+}
+
+void putBigEndian32(uint8_t* p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v >> 24);
+    p[1] = static_cast<uint8_t>(v >> 16);
+    p[2] = static_cast<uint8_t>(v >> 8);
+    p[3] = static_cast<uint8_t>(v);
+}
+
+bool writePngChunk(std::ofstream& out, const char type[4], const uint8_t* data, size_t size) {
+    uint8_t header[8];
+    putBigEndian32(header, static_cast<uint32_t>(size));
+    std::memcpy(header + 4, type, 4);
+    uint32_t crc = crc32(0, header + 4, 4);
+    crc = crc32(crc, data, size);
+    uint8_t trailer[4];
+    putBigEndian32(trailer, crc);
+    return writeBytes(out, header, 8) && writeBytes(out, data, size) && writeBytes(out, trailer, 4);
+}
+
+template <typename T>
+void append(std::vector<uint8_t>& buffer, const T& value) {
+    const size_t at = buffer.size();
+    buffer.resize(at + sizeof(T));
+    std::memcpy(buffer.data() + at, &value, sizeof(T));
+}
+
+void appendText(std::vector<uint8_t>& buffer, const char* text) {
+    buffer.insert(buffer.end(), text, text + std::strlen(text));
+}
+
+template <typename T>
+void appendNumber(std::vector<uint8_t>& buffer, T value) {
+    char digits[32];
+    const std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), value);
+    buffer.insert(buffer.end(), digits, result.ptr);
+}
+
+}
+
+bool exportPng16(const std::string& path, const HeightFieldView& heights, float low, float high, WorkerPool& pool) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+    const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    uint8_t ihdr[13];
+    putBigEndian32(ihdr, static_cast<uint32_t>(heights.width));
+    putBigEndian32(ihdr + 4, static_cast<uint32_t>(heights.height));
+    ihdr[8] = 16; // bit depth
+    ihdr[9] = 0;  // grayscale
+    ihdr[10] = 0; // deflate
+    ihdr[11] = 0; // adaptive filtering
+    ihdr[12] = 0; // no interlace
+    // Heights in metres are low + sample / 65535 * (high - low)
+    std::vector<uint8_t> range;
+    appendText(range, "Elevation range");
+    range.push_back(0);
+    appendNumber(range, low);
+    range.push_back(' ');
+    appendNumber(range, high);
+    const uint8_t zlibHeader[2] = { 0x78, 0x01 };
+    if (!writeBytes(out, signature, 8) || !writePngChunk(out, "IHDR", ihdr, 13) || !writePngChunk(out, "tEXt", range.data(), range.size())
+        || !writePngChunk(out, "IDAT", zlibHeader, 2)) {
+        return false;
+    }
+
+    /*
+        Each strip is its own IDAT chunk holding an independently compressed, byte-aligned piece
+        of the zlib stream. Rows use the Up filter; a strip recomputes the row above it, so
+        strips share nothing. The zlib checksum is combined from per-strip checksums.
+    */
+    const float scale = quantizeScale(low, high);
+    const size_t rowBytes = 1 + heights.width * 2;
+    const size_t stripRows = rowsPerStrip(rowBytes);
+    const size_t strips = (heights.height + stripRows - 1) / stripRows;
+    std::vector<uint32_t> stripAdler(strips);
+    std::vector<size_t> stripSize(strips);
+
+    auto samples = [&](size_t y, float* buffer, uint8_t* bytes) {
+        const float* row = heights.readRow(y, 0, heights.width, buffer);
+        for (size_t x = 0; x < heights.width; ++x) {
+            const uint16_t v = quantize(row[x], low, scale);
+            bytes[2 * x] = static_cast<uint8_t>(v >> 8);
+            bytes[2 * x + 1] = static_cast<uint8_t>(v);
+        }
+    };
+
+    uint32_t adler = 1;
+    const bool written = streamStrips(heights.height, stripRows, pool,
+        [&](size_t strip, size_t firstRow, size_t rows, std::vector<uint8_t>& buffer) {
+            std::vector<uint8_t> raw(rows * rowBytes);
+            std::vector<uint8_t> above(rowBytes - 1, 0);
+            std::vector<uint8_t> current(rowBytes - 1);
+            std::vector<float> row(heights.width);
+            if (firstRow > 0) {
+                samples(firstRow - 1, row.data(), above.data());
+            }
+            for (size_t r = 0; r < rows; ++r) {
+                samples(firstRow + r, row.data(), current.data());
+                uint8_t* filtered = raw.data() + r * rowBytes;
+                filtered[0] = 2; // Up
+                for (size_t i = 0; i < current.size(); ++i) {
+                    filtered[1 + i] = static_cast<uint8_t>(current[i] - above[i]);
+                }
+                std::swap(above, current);
+            }
+            stripAdler[strip] = adler32(1, raw.data(), raw.size());
+            stripSize[strip] = raw.size();
+            deflateSegment(raw.data(), raw.size(), strip + 1 == strips, buffer);
+        },
+        [&](size_t strip, const std::vector<uint8_t>& buffer) {
+            adler = adler32Combine(adler, stripAdler[strip], stripSize[strip]);
+            return writePngChunk(out, "IDAT", buffer.data(), buffer.size());
+        });
+    if (!written) {
+        return false;
+    }
+
+    uint8_t trailer[4];
+    putBigEndian32(trailer, adler);
+    return writePngChunk(out, "IDAT", trailer, 4) && writePngChunk(out, "IEND", nullptr, 0) && out.flush();
+}
+
+bool exportRaw16(const std::string& path, const HeightFieldView& heights, float low, float high, WorkerPool& pool) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+    const float scale = quantizeScale(low, high);
+    const size_t rowBytes = heights.width * 2;
+    return streamStrips(heights.height, rowsPerStrip(rowBytes), pool,
+        [&](size_t, size_t firstRow, size_t rows, std::vector<uint8_t>& buffer) {
+            buffer.resize(rows * rowBytes);
+            std::vector<float> samples(heights.width);
+            for (size_t r = 0; r < rows; ++r) {
+                const float* row = heights.readRow(firstRow + r, 0, heights.width, samples.data());
+                uint8_t* bytes = buffer.data() + r * rowBytes;
+                for (size_t x = 0; x < heights.width; ++x) {
+                    const uint16_t v = quantize(row[x], low, scale);
+                    bytes[2 * x] = static_cast<uint8_t>(v);
+                    bytes[2 * x + 1] = static_cast<uint8_t>(v >> 8);
+                }
+            }
+        },
+        [&](size_t, const std::vector<uint8_t>& buffer) {
+            return writeBytes(out, buffer.data(), buffer.size());
+        }) && out.flush();
+}
+
+bool exportPfm(const std::string& path, const HeightFieldView& heights) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+    // Negative scale marks little-endian data
+    out << "Pf\n" << heights.width << " " << heights.height << "\n-1.0\n";
+    std::vector<float> samples(heights.width);
+    for (size_t y = heights.height; y-- > 0;) {
+        if (!writeBytes(out, heights.readRow(y, 0, heights.width, samples.data()), heights.width * sizeof(float))) {
+            return false;
+        }
+    }
+    return static_cast<bool>(out.flush());
+}
+
+bool exportObj(const std::string& path, const HeightFieldView& heights, float spacing, WorkerPool& pool) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+    const size_t width = heights.width;
+    auto writeBuffer = [&](size_t, const std::vector<uint8_t>& buffer) {
+        return writeBytes(out, buffer.data(), buffer.size());
+    };
+
+    const bool vertices = streamStrips(heights.height, rowsPerStrip(width * 40), pool,
+        [&](size_t, size_t firstRow, size_t rows, std::vector<uint8_t>& buffer) {
+            std::vector<float> samples(width);
+            for (size_t y = firstRow; y < firstRow + rows; ++y) {
+                const float* row = heights.readRow(y, 0, width, samples.data());
+                for (size_t x = 0; x < width; ++x) {
+                    appendText(buffer, "v ");
+                    appendNumber(buffer, x * spacing);
+                    appendText(buffer, " ");
+                    appendNumber(buffer, y * spacing);
+                    appendText(buffer, " ");
+                    appendNumber(buffer, row[x]);
+                    appendText(buffer, "\n");
+                }
+            }
+        }, writeBuffer);
+    if (!vertices || width < 2 || heights.height < 2) {
+        return vertices && out.flush();
+    }
+
+    // OBJ indices start at 1
+    const bool faces = streamStrips(heights.height - 1, rowsPerStrip(width * 60), pool,
+        [&](size_t, size_t firstRow, size_t rows, std::vector<uint8_t>& buffer) {
+            for (size_t y = firstRow; y < firstRow + rows; ++y) {
+                for (size_t x = 0; x + 1 < width; ++x) {
+                    const uint64_t a = y * width + x + 1;
+                    const uint64_t b = a + 1;
+                    const uint64_t c = a + width;
+                    const uint64_t d = c + 1;
+                    const uint64_t triangles[2][3] = { { a, b, c }, { c, b, d } };
+                    for (const auto& t : triangles) {
+                        appendText(buffer, "f");
+                        for (uint64_t index : t) {
+                            appendText(buffer, " ");
+                            appendNumber(buffer, index);
+                        }
+                        appendText(buffer, "\n");
+                    }
+                }
+            }
+        }, writeBuffer);
+    return faces && out.flush();
+}
+
+bool exportPly(const std::string& path, const HeightFieldView& heights, float spacing, WorkerPool& pool) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+    const size_t width = heights.width;
+    const size_t quads = width > 1 && heights.height > 1 ? (width - 1) * (heights.height - 1) : 0;
+    out << "ply\nformat binary_little_endian 1.0\n"
+        << "element vertex " << width * heights.height << "\n"
+        << "property float x\nproperty float y\nproperty float z\n"
+        << "element face " << quads * 2 << "\n"
+        << "property list uchar int vertex_indices\nend_header\n";
+
+    auto writeBuffer = [&](size_t, const std::vector<uint8_t>& buffer) {
+        return writeBytes(out, buffer.data(), buffer.size());
+    };
+
+    const bool vertices = streamStrips(heights.height, rowsPerStrip(width * 12), pool,
+        [&](size_t, size_t firstRow, size_t rows, std::vector<uint8_t>& buffer) {
+            buffer.reserve(rows * width * 12);
+            std::vector<float> samples(width);
+            for (size_t y = firstRow; y < firstRow + rows; ++y) {
+                const float* row = heights.readRow(y, 0, width, samples.data());
+                for (size_t x = 0; x < width; ++x) {
+                    append(buffer, x * spacing);
+                    append(buffer, y * spacing);
+                    append(buffer, row[x]);
+                }
+            }
+        }, writeBuffer);
+    if (!vertices || quads == 0) {
+        return vertices && out.flush();
+    }
+
+    const bool faces = streamStrips(heights.height - 1, rowsPerStrip(width * 26), pool,
+        [&](size_t, size_t firstRow, size_t rows, std::vector<uint8_t>& buffer) {
+            buffer.reserve(rows * (width - 1) * 26);
+            for (size_t y = firstRow; y < firstRow + rows; ++y) {
+                for (size_t x = 0; x + 1 < width; ++x) {
+                    const int32_t a = static_cast<int32_t>(y * width + x);
+                    const int32_t b = a + 1;
+                    const int32_t c = a + static_cast<int32_t>(width);
+                    const int32_t d = c + 1;
+                    const int32_t triangles[2][3] = { { a, b, c }, { c, b, d } };
+                    for (const auto& t : triangles) {
+                        append(buffer, static_cast<uint8_t>(3));
+                        append(buffer, t);
+                    }
+                }
+            }
+        }, writeBuffer);
+    return faces && out.flush();
+}
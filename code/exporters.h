@@ -0,0 +1,29 @@
+#pragma once
+
+#include "heightfield.h"
+#include "workers.h"
+#include <string>
+
+/*
+	Terrain exporters. Each one streams the map in strips of rows: a few strips are encoded
+	in parallel on the worker pool, then written in order, so memory stays bounded by
+	strip size x pool size whatever the map size. All return false on I/O errors.
+	16-bit maps are dequantized a row at a time as they're read.
+
+	Height maps quantize [low; high] to the full 16-bit range; PNGs keep the range in an
+	"Elevation range" tEXt chunk, raw files have nowhere to put it.
+	Meshes use the renderer's grid: point (x, y) at (x * spacing, y * spacing, height),
+	every quad split into (x, y) (x + 1, y) (x, y + 1) and (x, y + 1) (x + 1, y) (x + 1, y + 1),
+	counter-clockwise seen from above.
+*/
+
+// 16-bit grayscale PNG, compressed with deflateSegment() per strip
+bool exportPng16(const std::string& path, const HeightFieldView& heights, float low, float high, WorkerPool& pool = WorkerPool::shared());
+// Headerless little-endian uint16 rows (.r16 / .raw)
+bool exportRaw16(const std::string& path, const HeightFieldView& heights, float low, float high, WorkerPool& pool = WorkerPool::shared());
+// Little-endian single-channel PFM, rows bottom to top as the format requires
+bool exportPfm(const std::string& path, const HeightFieldView& heights);
+// Wavefront OBJ: all vertices, then all faces
+bool exportObj(const std::string& path, const HeightFieldView& heights, float spacing, WorkerPool& pool = WorkerPool::shared());
+// Binary little-endian PLY
+bool exportPly(const std::string& path, const HeightFieldView& heights, float spacing, WorkerPool& pool = WorkerPool::shared());
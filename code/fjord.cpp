@@ -1,9 +1,26 @@
 ﻿#include "fjord.h"
+#include "workers.h"
+#include "exporters.h"
+#include "profiler.h"
 
-Fjord::Fjord(std::unique_ptr<HeightGenerator>generator) : generator{ std::move(generator) } {}
+#include <algorithm>
+#include <cctype>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <utility>
+
+Fjord::Fjord(std::unique_ptr<HeightGenerator> generator, std::unique_ptr<HeightGenerator> streamGenerator) : generator{ std::move(generator) } {
+    if (streamGenerator) {
+        stream = std::make_unique<TerrainStream>(std::move(streamGenerator));
+    }
+}
 
 void Fjord::update(bool _regen, int octave, int seed,
     int maxElevation, int tileSize, bool isLake, float waterPercentage) {
+    ProfileScope profile(ProfileStage::Update);
     /*
         Update settings
     */
@@ -13,69 +30,486 @@ void Fjord::update(bool _regen, int octave, int seed,
     this->tileSize = tileSize;
     this->isLake = isLake;
     this->waterPercentage = waterPercentage;
+    this->octave = octave;
+    this->seed = seed;
     this->size /= this->tileSize;
 
     /*
         Apply settings
     */
-    heightMap = generator->generate(this->size);
+    windowValid = false;
+    if (streaming) {
+        streamWindow();
+        return;
+    }
+    NoiseKey key;
+    key.seed = seed;
+    key.octave = octave;
+    key.size = this->size;
+    if (!noiseValid || !(key == noiseKey)) {
+        noiseValid = false;
+        generateNoise();
+        if (cancelled()) {
+            return;
+        }
+        noiseKey = key;
+        noiseValid = true;
+    }
     this->applyMapType();
+    buildQuadtree();
+
+}
 
+void Fjord::setCancelFlag(const std::atomic<bool>* cancel) {
+    this->cancel = cancel;
+    generator->setCancelFlag(cancel);
+}
+
+bool Fjord::cancelled() const {
+    return cancel && cancel->load(std::memory_order_relaxed);
+}
+
+bool Fjord::hasNoise(int octave, int seed, int tileSize) const {
+    NoiseKey key;
+    key.seed = seed;
+    key.octave = octave;
+    key.size = 10000 / tileSize;
+    return !streaming && noiseValid && key == noiseKey;
+}
+
+void Fjord::swapMap(Fjord& other) {
+    std::swap(maxElevation, other.maxElevation);
+    std::swap(tileSize, other.tileSize);
+    std::swap(size, other.size);
+    std::swap(flatten, other.flatten);
+    std::swap(isLake, other.isLake);
+    std::swap(waterPercentage, other.waterPercentage);
+    std::swap(octave, other.octave);
+    std::swap(seed, other.seed);
+    std::swap(heightMap, other.heightMap);
+    std::swap(quantizedMap, other.quantizedMap);
+    std::swap(quantized, other.quantized);
+    // Seed offsets belong with the map they generated
+    std::swap(generator, other.generator);
+    generator->setCancelFlag(cancel);
+    other.generator->setCancelFlag(other.cancel);
+    std::swap(noiseField, other.noiseField);
+    std::swap(mappedNoise, other.mappedNoise);
+    std::swap(noise, other.noise);
+    std::swap(noiseMin, other.noiseMin);
+    std::swap(noiseRange, other.noiseRange);
+    std::swap(noiseKey, other.noiseKey);
+    std::swap(noiseValid, other.noiseValid);
+    std::swap(quadtree, other.quadtree);
+    std::swap(chunkNormals, other.chunkNormals);
+    windowValid = false;
+    other.windowValid = false;
 }
 
 void Fjord::initHeightMap() {
-    heightMap.clear();
-    for (int y = 0; y <= size; y++) {
-        vector<float> row;
-        for (int x = 0; x <= size; x++)
-            row.push_back(0);
-        heightMap.push_back(row);
+    heightMap.resize(size + 1, size + 1);
+    heightMap.fill(0.0f);
+}
+
+void Fjord::streamWindow() {
+    // Chunks are already normalized by the fixed noise bound, per-map min/max would break seams
+    noiseValid = false;
+    const size_t points = size + 1;
+    windowOrigin(windowX, windowY);
+    stream->setWindow(seed, octave, size, windowX, windowY, points, points);
+    noiseField.resize(points, points);
+    stream->copy(windowX, windowY, points, points, noiseField, 0, 0);
+    mappedNoise.reset();
+    noise = noiseField.view();
+    setNoiseRange(0.0f, 1.0f);
+    applyMapType();
+    buildQuadtree();
+    windowValid = true;
+}
+
+void Fjord::windowOrigin(long long& x0, long long& y0) const {
+    // Large windows move in whole stream chunks, so the lower quadtree levels can scroll along
+    const long long align = size >= minScrolledSize ? TerrainStream::chunkQuads : 1;
+    x0 = std::llround(originX * size / align) * align;
+    y0 = std::llround(originY * size / align) * align;
+}
+
+bool Fjord::positionalMapType() const {
+    // The lake blend in applyMapType(): heights depend on the distance from the window centre
+    return isLake && waterPercentage <= 0.95f && waterPercentage >= 0.05f;
+}
+
+float Fjord::highestHeight() const {
+    // The lake blend peaks in the corners, sqrt(0.5) from the centre, well above maxElevation for small lakes
+    const float maxEuclideanDistance = pow(waterPercentage, 0.5);
+    float highest = positionalMapType() ? (1.0f + sqrt(0.5f) / maxEuclideanDistance) / 2.0f : 1.0f;
+    if (flatten != 1.0f) {
+        highest = pow(highest, flatten);
+    }
+    const float lo = isLake && waterPercentage < 0.05f ? 10.0f : static_cast<float>(-maxElevation);
+    const float span = static_cast<float>(maxElevation) - lo;
+    return std::max(highest * span + lo, lo);
+}
+
+void Fjord::scrollWindow(long long x0, long long y0) {
+    const long long dx = x0 - windowX;
+    const long long dy = y0 - windowY;
+    const size_t points = size + 1;
+    windowX = x0;
+    windowY = y0;
+    stream->setWindow(seed, octave, size, windowX, windowY, points, points);
+    noiseField.scroll(dx, dy);
+
+    // Uncovered rows, then uncovered columns of the remaining rows
+    struct Region {
+        size_t x0, y0, x1, y1;
+    };
+    std::vector<Region> uncovered;
+    const size_t rows = static_cast<size_t>(std::abs(dy));
+    const size_t columns = static_cast<size_t>(std::abs(dx));
+    const size_t keptY0 = dy < 0 ? rows : 0;
+    const size_t keptY1 = dy > 0 ? points - rows : points;
+    if (rows > 0) {
+        uncovered.push_back(dy > 0 ? Region{ 0, keptY1, points, points } : Region{ 0, 0, points, keptY0 });
+    }
+    if (columns > 0) {
+        uncovered.push_back(dx > 0 ? Region{ points - columns, keptY0, points, keptY1 } : Region{ 0, keptY0, columns, keptY1 });
+    }
+    for (const Region& r : uncovered) {
+        stream->copy(windowX + static_cast<long long>(r.x0), windowY + static_cast<long long>(r.y0), r.x1 - r.x0, r.y1 - r.y0, noiseField, r.x0, r.y0);
+    }
+
+    if (positionalMapType()) {
+        applyMapType();
+        buildQuadtree();
+        return;
+    }
+    if (quantized) {
+        quantizedMap.scroll(dx, dy);
+    }
+    else {
+        heightMap.scroll(dx, dy);
+    }
+    for (const Region& r : uncovered) {
+        applyMapType(r.x0, r.y0, r.x1, r.y1);
+    }
+    quadtree.scroll(getHeightMap(), static_cast<int>(dx), static_cast<int>(dy));
+    // Filled again on demand, for the chunks that get drawn
+    for (std::vector<float>& normals : chunkNormals) {
+        normals.clear();
+    }
+}
+
+void Fjord::refreshRegion(size_t x0, size_t y0, size_t x1, size_t y1) {
+    stream->copy(windowX + static_cast<long long>(x0), windowY + static_cast<long long>(y0), x1 - x0, y1 - y0, noiseField, x0, y0);
+    applyMapType(x0, y0, x1, y1);
+    std::vector<uint32_t> changed;
+    quadtree.update(getHeightMap(), static_cast<int>(x0), static_cast<int>(y0), static_cast<int>(x1) - 1, static_cast<int>(y1) - 1, changed);
+    for (uint32_t index : changed) {
+        chunkNormals[index].clear();
     }
 }
 
+void Fjord::setStreaming(bool streaming) {
+    this->streaming = streaming && stream;
+}
+
+bool Fjord::isStreaming() const {
+    return streaming;
+}
+
+void Fjord::pan(double dx, double dy) {
+    if (!streaming) {
+        return;
+    }
+    originX += dx;
+    originY += dy;
+    long long x0 = 0;
+    long long y0 = 0;
+    windowOrigin(x0, y0);
+    const long long points = size + 1;
+    const long long shiftX = x0 - windowX;
+    const long long shiftY = y0 - windowY;
+    if (windowValid && shiftX == 0 && shiftY == 0) {
+        return;
+    }
+    // Scrolling keeps the quadtree levels up to a stream chunk; other shifts are small maps
+    const bool aligned = shiftX % TerrainStream::chunkQuads == 0 && shiftY % TerrainStream::chunkQuads == 0;
+    if (windowValid && aligned && std::abs(shiftX) < points && std::abs(shiftY) < points) {
+        scrollWindow(x0, y0);
+    }
+    else {
+        streamWindow();
+    }
+}
+
+bool Fjord::refreshStream() {
+    if (!streaming) {
+        return false;
+    }
+    const std::vector<TerrainStream::ChunkCoord> arrived = stream->takeArrivals();
+    if (arrived.empty()) {
+        return false;
+    }
+    if (!windowValid) {
+        streamWindow();
+        return true;
+    }
+    // Only the arrived chunks' points change, in the noise, the heights and the quadtree
+    const long long points = size + 1;
+    const long long chunkQuads = TerrainStream::chunkQuads;
+    for (const TerrainStream::ChunkCoord& c : arrived) {
+        const long long x0 = std::max(c.cx * chunkQuads - windowX, 0LL);
+        const long long y0 = std::max(c.cy * chunkQuads - windowY, 0LL);
+        const long long x1 = std::min(c.cx * chunkQuads + chunkQuads - windowX, points);
+        const long long y1 = std::min(c.cy * chunkQuads + chunkQuads - windowY, points);
+        if (x0 < x1 && y0 < y1) {
+            refreshRegion(static_cast<size_t>(x0), static_cast<size_t>(y0), static_cast<size_t>(x1), static_cast<size_t>(y1));
+        }
+    }
+    return true;
+}
+
+void Fjord::generateNoise() {
+    const bool cacheable = !cacheDirectory.empty() && size >= minCachedSize;
+    const std::string path = cacheable ? cachePath() : std::string();
+    mappedNoise.reset();
+    if (cacheable && loadCachedNoise(path)) {
+        return;
+    }
+
+    generator->generate(this->size, noiseField);
+    noise = noiseField.view();
+    setNoiseRange(generator->getMinNoise(), generator->getMaxNoise());
+    if (cacheable && !cancelled()) {
+        // A failed write only costs the next session a regeneration
+        saveHeightMap(path, makeHeightMapHeader(seed, octave, size, generator->getMinNoise(), generator->getMaxNoise(), generator->getId()), noise);
+    }
+}
 
+void Fjord::setNoiseRange(float minNoise, float maxNoise) {
+    // Same arithmetic as ofMap(v, minNoise, maxNoise, 0, 1), including its degenerate range case
+    noiseMin = minNoise;
+    noiseRange = fabs(maxNoise - minNoise) < FLT_EPSILON ? 0.0f : maxNoise - minNoise;
+}
+
+std::string Fjord::cachePath() const {
+    const std::string id = generator->getId();
+    char name[96];
+    snprintf(name, sizeof(name), "s%d-o%d-n%d-%016llx.fjh", seed, octave, size, static_cast<unsigned long long>(std::hash<std::string>()(id)));
+    return (std::filesystem::path(cacheDirectory) / name).string();
+}
+
+bool Fjord::loadCachedNoise(const std::string& path) {
+    std::unique_ptr<MappedHeightMap> mapped = MappedHeightMap::open(path);
+    if (!mapped) {
+        return false;
+    }
+    const HeightMapHeader& header = mapped->getHeader();
+    const uint64_t points = static_cast<uint64_t>(size) + 1;
+    const std::string id = generator->getId().substr(0, sizeof(header.generator) - 1);
+    if (header.seed != seed || header.octave != octave || header.size != static_cast<uint64_t>(size)
+        || header.width != points || header.height != points || id != header.generator) {
+        return false;
+    }
+    mappedNoise = std::move(mapped);
+    noise = mappedNoise->view();
+    setNoiseRange(header.minNoise, header.maxNoise);
+    return true;
+}
+
+void Fjord::setCacheDirectory(const std::string& directory) {
+    cacheDirectory = directory;
+    if (!directory.empty()) {
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+    }
+}
+
+bool Fjord::exportTerrain(const std::string& path) const {
+    const std::filesystem::path target(path);
+    if (target.has_parent_path()) {
+        std::error_code error;
+        std::filesystem::create_directories(target.parent_path(), error);
+    }
+    std::string extension = target.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+    const HeightFieldView view = getHeightMap();
+    if (extension == ".png") {
+        return exportPng16(path, view, 0.0f, highestHeight());
+    }
+    if (extension == ".r16" || extension == ".raw") {
+        return exportRaw16(path, view, 0.0f, highestHeight());
+    }
+    if (extension == ".pfm") {
+        return exportPfm(path, view);
+    }
+    if (extension == ".obj") {
+        return exportObj(path, view, static_cast<float>(tileSize));
+    }
+    if (extension == ".ply") {
+        return exportPly(path, view, static_cast<float>(tileSize));
+    }
+    return false;
+}
+
+/*
+    Per point this matches the original per-pixel branches exactly:
+        plain:  ofMap(pow(n, flatten), 0, 1, -maxElevation, maxElevation), clamped at 0
+        lake:   blend with the distance from the centre, or all water / all land
+                at the ends of the lake size range
+    but the mode is chosen once per update and every row is a straight loop.
+    pow(n, 1) is n, so the default flatten skips it.
+*/
 void Fjord::applyMapType() {
-    float maxEuclideanDistance = pow(waterPercentage, 0.5);
-    float minNoise = generator->getMinNoise();
-    float maxNoise = generator->getMaxNoise();
-
-    for (int y = 0; y <= size; ++y) {
-        for (int x = 0; x <= size; ++x) {
-            if (!isLake) {
-                float noiseValue = heightMap.at(y).at(x);
-                noiseValue = ofMap(noiseValue, minNoise, maxNoise, 0, 1);
-                noiseValue = pow(noiseValue, flatten);
-                heightMap.at(y).at(x) = ofMap(noiseValue, 0, 1, -maxElevation, maxElevation);
-                if (heightMap.at(y).at(x) < 0.0f)
-                    heightMap.at(y).at(x) = 0.0f;
+    // Only the map in use keeps its memory
+    const size_t points = size + 1;
+    if (quantized) {
+        heightMap = HeightField();
+        quantizedMap.resize(points, points);
+    }
+    else {
+        quantizedMap = QuantizedHeightField();
+        heightMap.resize(points, points);
+    }
+    applyMapType(0, 0, points, points);
+}
+
+void Fjord::applyMapType(size_t x0, size_t y0, size_t x1, size_t y1) {
+    ProfileScope profile(ProfileStage::Remap);
+    const float maxEuclideanDistance = pow(waterPercentage, 0.5);
+    const bool applyFlatten = flatten != 1.0f;
+    const size_t columns = x1 - x0;
+
+    enum class Mode { Plain, Water, Land, Blend };
+    Mode mode = Mode::Plain;
+    if (isLake) {
+        mode = waterPercentage > 0.95f ? Mode::Water : waterPercentage < 0.05f ? Mode::Land : Mode::Blend;
+    }
+
+    // ofMap(v, 0, 1, lo, hi) == v * (hi - lo) + lo
+    const float lo = mode == Mode::Land ? 10.0f : static_cast<float>(-maxElevation);
+    const float span = static_cast<float>(maxElevation) - lo;
+
+    // Squared centre offsets per column, in double as pow(float, int) computes them
+    std::vector<double> dx2;
+    if (mode == Mode::Blend) {
+        dx2.resize(columns);
+        for (size_t x = x0; x < x1; ++x) {
+            dx2[x - x0] = pow((float)x / size - 0.5f, 2);
+        }
+    }
+
+    // row[k] is point x0 + k
+    const bool flat = noiseRange == 0.0f;
+    auto remapRow = [&](size_t y, float* row) {
+        const float* raw = noise.row(y);
+        auto normalized = [&](size_t x) { return flat ? 0.0f : (raw[x] - noiseMin) / noiseRange; };
+
+        switch (mode) {
+        case Mode::Water:
+            std::fill(row, row + columns, 0.0f);
+            break;
+
+        case Mode::Land:
+            for (size_t x = x0; x < x1; ++x) {
+                const float n = applyFlatten ? pow(normalized(x), flatten) : normalized(x);
+                row[x - x0] = n * span + lo;
             }
-            else {
-                float euclideanDistance = sqrt(pow((float)x / size - 0.5f, 2) + pow((float)y / size - 0.5f, 2));
-                float noiseValue = heightMap.at(y).at(x);
-                noiseValue = ofMap(noiseValue, minNoise, maxNoise, 0, 1);
+            break;
 
-                if (waterPercentage > 0.95f) {
-                    heightMap.at(y).at(x) = 0.0f; 
-                }
-                else if (waterPercentage < 0.05f) {
-                    noiseValue = pow(noiseValue, flatten);
-                    heightMap.at(y).at(x) = ofMap(noiseValue, 0, 1, 10, maxElevation); 
-                }
-                else {
-                    float blendedValue = (noiseValue + euclideanDistance / maxEuclideanDistance) / 2.0f;
+        case Mode::Plain:
+            for (size_t x = x0; x < x1; ++x) {
+                const float n = applyFlatten ? pow(normalized(x), flatten) : normalized(x);
+                row[x - x0] = std::max(n * span + lo, 0.0f);
+            }
+            break;
+
+        case Mode::Blend: {
+            const double dy2 = pow((float)y / size - 0.5f, 2);
+            for (size_t x = x0; x < x1; ++x) {
+                const float euclideanDistance = sqrt(dx2[x - x0] + dy2);
+                float blendedValue = (normalized(x) + euclideanDistance / maxEuclideanDistance) / 2.0f;
+                if (applyFlatten) {
                     blendedValue = pow(blendedValue, flatten);
-                    heightMap.at(y).at(x) = ofMap(blendedValue, 0, 1, -maxElevation, maxElevation);
-                    if (heightMap.at(y).at(x) < 0.0f)
-                        heightMap.at(y).at(x) = 0.0f;
                 }
+                row[x - x0] = std::max(blendedValue * span + lo, 0.0f);
             }
+            break;
+        }
+        }
+    };
+
+    if (!quantized) {
+        WorkerPool::shared().parallelFor(y1 - y0, [&](size_t k) { remapRow(y0 + k, heightMap.row(y0 + k) + x0); });
+        return;
+    }
+
+    /*
+        16-bit maps are remapped a row at a time into a buffer and quantized from there,
+        over [0; highestHeight()] so nothing clamps. The range only depends on the settings,
+        so partial remaps agree with the rest of the map.
+    */
+    quantizedMap.setRange(0.0f, highestHeight());
+    constexpr size_t stripRows = 16;
+    WorkerPool::shared().parallelFor((y1 - y0 + stripRows - 1) / stripRows, [&](size_t strip) {
+        std::vector<float> row(columns);
+        for (size_t y = y0 + strip * stripRows; y < std::min(y1, y0 + (strip + 1) * stripRows); ++y) {
+            remapRow(y, row.data());
+            quantizedMap.storeRow(y, x0, columns, row.data());
         }
+    });
+}
+
+
+HeightFieldView Fjord::getHeightMap() const {
+    return quantized ? quantizedMap.view() : heightMap.view();
+}
+
+void Fjord::setQuantized(bool quantized) {
+    // The streamed window is then remapped as a whole on its next move
+    if (quantized != this->quantized) {
+        windowValid = false;
     }
+    this->quantized = quantized;
+}
+
+bool Fjord::isQuantized() const {
+    return quantized;
+}
+
+const TerrainQuadtree& Fjord::getQuadtree() const {
+    return quadtree;
 }
 
+void Fjord::buildQuadtree() {
+    quadtree.build(getHeightMap(), size - 1);
+    chunkNormals.clear();
+    chunkNormals.resize(quadtree.getChunkCount());
+}
 
-std::vector<std::vector<float>> Fjord::getHeightMap() {
-    return heightMap;
+const float* Fjord::getChunkNormals(const TerrainChunk& chunk) {
+    constexpr int n = TerrainChunk::chunkQuads;
+    std::vector<float>& normals = chunkNormals[chunk.index];
+    if (!normals.empty()) {
+        return normals.data();
+    }
+    normals.resize(static_cast<size_t>(n) * n * 6);
+    const HeightFieldView heights = getHeightMap();
+    const int quads = quadtree.getQuads();
+    const int step = chunk.step();
+    for (int l = 0; l < n && chunk.y0 + l * step < quads; ++l) {
+        const int y0 = chunk.y0 + l * step;
+        const int y1 = std::min(y0 + step, quads);
+        for (int k = 0; k < n && chunk.x0 + k * step < quads; ++k) {
+            const int x0 = chunk.x0 + k * step;
+            const int x1 = std::min(x0 + step, quads);
+            const float h[4] = { heights.at(x0, y0), heights.at(x1, y0), heights.at(x0, y1), heights.at(x1, y1) };
+            quadNormals(x0, y0, x1, y1, h, tileSize, &normals[(static_cast<size_t>(l) * n + k) * 6]);
+        }
+    }
+    return normals.data();
 }
 
 int Fjord::getSize() {
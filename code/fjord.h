@@ -1,9 +1,14 @@
 #pragma once
 
-#include "ofMain.h"
 #include "generator.h"
+#include "heightfield.h"
+#include "terrain.h"
+#include "stream.h"
+#include "mapfile.h"
+#include <atomic>
 #include <vector>
 #include <memory>
+#include <string>
 
 class Fjord {
 private:
@@ -14,18 +19,157 @@ private:
 
 	bool isLake = false;
 	float waterPercentage = 0.5f;
+	int octave = 8;
+	int seed = 0;
 
-	std::vector<std::vector<float>> heightMap;
+	HeightField heightMap;
+	// Holds the map instead of heightMap in 16-bit mode, see setQuantized()
+	QuantizedHeightField quantizedMap;
+	bool quantized = false;
 	std::unique_ptr<HeightGenerator> generator;
 
+	/*
+		Raw generator output kept between updates: generated into noiseField or mapped
+		from the on-disk cache, 'noise' views whichever holds it. applyMapType() normalizes
+		on the fly to [0; 1] with noiseMin / noiseRange (range 0 means a flat map).
+		Generation is a pure function of (seed, octave, size), so when those match
+		only applyMapType() runs: elevation and lake changes skip the octave loop.
+	*/
+	HeightField noiseField;
+	std::unique_ptr<MappedHeightMap> mappedNoise;
+	HeightFieldView noise;
+	float noiseMin = 0;
+	float noiseRange = 1;
+	struct NoiseKey {
+		int seed = 0;
+		int octave = 0;
+		int size = 0;
+		bool operator==(const NoiseKey& other) const {
+			return seed == other.seed && octave == other.octave && size == other.size;
+		}
+	};
+	NoiseKey noiseKey;
+	bool noiseValid = false;
+
+	/*
+		Maps of at least minCachedSize are saved to cacheDirectory after generation
+		and mapped back in instead of generated next time.
+	*/
+	static constexpr int minCachedSize = 1000;
+	std::string cacheDirectory;
+
+	// LOD pyramid over the height map, rebuilt with it
+	TerrainQuadtree quadtree;
+	/*
+		Face normals per chunk (see getChunkNormals()), indexed by TerrainChunk::index.
+		Filled on first use, dropped whenever the height map changes.
+	*/
+	std::vector<std::vector<float>> chunkNormals;
+
+	/*
+		Streaming mode: noiseField is a window into an endless world, assembled from
+		stream chunks. The window origin is in map widths so it survives tile size changes.
+		windowX / windowY is the grid point noiseField and the height map start at while
+		windowValid; pans scroll them and arrivals refresh just their chunks.
+	*/
+	std::unique_ptr<TerrainStream> stream;
+	bool streaming = false;
+	double originX = 0;
+	double originY = 0;
+	long long windowX = 0;
+	long long windowY = 0;
+	bool windowValid = false;
+	// From this size on windows move in whole stream chunks: a pan step then spans at least one
+	static constexpr int minScrolledSize = 4 * TerrainStream::chunkQuads;
+
+	// See setCancelFlag()
+	const std::atomic<bool>* cancel = nullptr;
+
 	void initHeightMap();
+	void buildQuadtree();
+	void generateNoise();
+	void setNoiseRange(float minNoise, float maxNoise);
+	std::string cachePath() const;
+	bool loadCachedNoise(const std::string& path);
+	// Fills the window from scratch
+	void streamWindow();
+	void windowOrigin(long long& x0, long long& y0) const;
+	bool positionalMapType() const;
+	// Top of the heights applyMapType() can produce with the current settings
+	float highestHeight() const;
+	// Moves the window to start at (x0, y0), generating only what it uncovers
+	void scrollWindow(long long x0, long long y0);
+	// Copies points [x0; x1) x [y0; y1) of the window from the stream again and remaps them
+	void refreshRegion(size_t x0, size_t y0, size_t x1, size_t y1);
+	// noise -> height map in one pass: elevation mapping, flatten and lake blend
 	void applyMapType();
+	// Same for points [x0; x1) x [y0; y1) of an already sized map
+	void applyMapType(size_t x0, size_t y0, size_t x1, size_t y1);
+	bool cancelled() const;
 
 public:
-	Fjord(std::unique_ptr<HeightGenerator> generator);
+	/*
+		'streamGenerator' feeds the streaming mode on its own thread; without it streaming is unavailable.
+	*/
+	Fjord(std::unique_ptr<HeightGenerator> generator, std::unique_ptr<HeightGenerator> streamGenerator = nullptr);
 	void update(bool _regen = true, int octave = 8, int seed = 0,
 		int maxElevation = 3000, int tileSize = 50, bool isLake = false, float waterPercentage = 0.5);
-	std::vector<std::vector<float>> getHeightMap();
+	/*
+		Once *cancel is set, update() stops as soon as it can. The map is then unusable
+		until an update() completes, which regenerates whatever was cut short.
+	*/
+	void setCancelFlag(const std::atomic<bool>* cancel);
+	// Whether the noise of (octave, seed, tileSize) is already here, so update() only remaps it
+	bool hasNoise(int octave, int seed, int tileSize) const;
+	/*
+		Exchanges the generated maps and their settings with 'other': a map built in the
+		background can be taken over without copying. Streaming state, the cache directory
+		and cancel flags stay with their Fjord.
+	*/
+	void swapMap(Fjord& other);
+	/*
+		Borrowed view, valid until the next update().
+		Read it with at() or readRow(): in 16-bit mode it has no float rows.
+	*/
+	HeightFieldView getHeightMap() const;
+	/*
+		Stores the height map as uint16 (QuantizedHeightField): half the memory and
+		bandwidth for readers, at a step of a few hundredths in height. Takes effect on the next update().
+	*/
+	void setQuantized(bool quantized);
+	bool isQuantized() const;
+	/*
+		Chunk pyramid covering the rendered (size - 1) x (size - 1) quads of getHeightMap().
+	*/
+	const TerrainQuadtree& getQuadtree() const;
+	/*
+		Face normals of the chunk's own mesh, from unstitched heights: quadNormals() of
+		quad (k, l) at [(l * TerrainChunk::chunkQuads + k) * 6]. Computed on first request
+		after the map changed; calls for different chunks may run concurrently.
+	*/
+	const float* getChunkNormals(const TerrainChunk& chunk);
+
+	// Directory for cached height maps, created if missing; empty disables the cache
+	void setCacheDirectory(const std::string& directory);
+
+	/*
+		Writes the current height map, format picked by extension:
+		.png (16-bit), .r16 / .raw (uint16), .pfm (float), .obj / .ply (mesh).
+		Heights quantize over [0; highestHeight()], which is maxElevation except for lake blend
+		maps that rise above it; the PNG records the range in a tEXt chunk. Meshes use tileSize spacing.
+		Returns false for an unknown extension or on I/O errors.
+	*/
+	bool exportTerrain(const std::string& path) const;
+
+	void setStreaming(bool streaming);
+	bool isStreaming() const;
+	// Moves the streamed window by (dx, dy) map widths
+	void pan(double dx, double dy);
+	/*
+		Picks up chunks the stream finished since the last call.
+		Returns true if the height map changed.
+	*/
+	bool refreshStream();
 	int getSize();
 	int getTileSize();
 	int getMaxElevation();
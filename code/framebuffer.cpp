@@ -0,0 +1,22 @@
+#include "framebuffer.h"
+
+void FrameBuffer::resize(int width, int height) {
+    if (width == this->width && height == this->height && color.isAllocated()) {
+        return;
+    }
+    this->width = width;
+    this->height = height;
+    color.allocate(width, height, OF_PIXELS_RGBA);
+}
+
+void FrameBuffer::clear(const ofColor& background) {
+    const unsigned char px[4] = { background.r, background.g, background.b, 255 };
+    unsigned char* data = color.getData();
+    const size_t count = static_cast<size_t>(width) * height;
+    for (size_t i = 0; i < count; ++i) {
+        data[i * 4 + 0] = px[0];
+        data[i * 4 + 1] = px[1];
+        data[i * 4 + 2] = px[2];
+        data[i * 4 + 3] = px[3];
+    }
+}
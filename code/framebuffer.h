@@ -0,0 +1,37 @@
+#pragma once
+
+#include "ofMain.h"
+#include <vector>
+
+/*
+	CPU-side RGBA8 render target.
+	Rasterizers write here; the result is uploaded to GL once per frame
+	or saved to disk without touching GL at all.
+	Depth is owned by the rasterizer (per screen tile).
+*/
+class FrameBuffer {
+private:
+	ofPixels color;
+	int width = 0;
+	int height = 0;
+
+public:
+	// Reallocates only when dimensions change
+	void resize(int width, int height);
+	void clear(const ofColor& background);
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+
+	unsigned char* colorRow(int y) { return color.getData() + static_cast<size_t>(y) * width * 4; }
+
+	void setPixel(int x, int y, const ofColor& c) {
+		unsigned char* p = colorRow(y) + x * 4;
+		p[0] = c.r;
+		p[1] = c.g;
+		p[2] = c.b;
+		p[3] = 255;
+	}
+
+	const ofPixels& getPixels() const { return color; }
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <type_traits>
+#include <utility>
+
+template <typename Signature>
+class FunctionRef;
+
+/*
+	Non-owning reference to a callable: a pointer to it plus a call thunk.
+	Unlike std::function it never allocates, so per-frame callbacks stay off the heap.
+	The callable must outlive the reference; passing a lambda straight into a call is fine.
+*/
+template <typename R, typename... Args>
+class FunctionRef<R(Args...)> {
+private:
+	const void* callable;
+	R (*invoke)(const void*, Args...);
+
+public:
+	template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, FunctionRef>>>
+	FunctionRef(const F& f)
+		: callable{ &f },
+		invoke{ [](const void* c, Args... args) -> R { return (*static_cast<const F*>(c))(std::forward<Args>(args)...); } } {}
+
+	R operator()(Args... args) const { return invoke(callable, std::forward<Args>(args)...); }
+};
@@ -1,70 +1,90 @@
 #include "generator.h"
+#include "workers.h"
+#include "profiler.h"
 
-OctaveGenerator::OctaveGenerator(std::function<float(float, float)> noise) : noise{ noise } {}
+#include <limits>
 
-void OctaveGenerator::reconfigure(bool _regen, int octave, int seed) {
+void OctaveGeneratorBase::reconfigure(bool _regen, int octave, int seed) {
     this->_regen = _regen;
     this->octave = octave;
     this->seed = seed;
 }
 
-void OctaveGenerator::regenSeeds() {
+void OctaveGeneratorBase::setCancelFlag(const std::atomic<bool>* cancel) {
+    this->cancel = cancel;
+}
+
+void OctaveGeneratorBase::regenSeeds() {
+    // Same sequence as ofSeedRandom(seed) + ofRandom(255) on the MSVC runtime, without linking openFrameworks
+    SeedRandom random(seed);
+    offsetSeed = seed;
+    auto next = [&](float max) {
+        return (max * random.next() / float(SeedRandom::max)) * (1.0f - std::numeric_limits<float>::epsilon());
+    };
     seedOffsetX.clear();
     seedOffsetY.clear();
-    ofSeedRandom(seed);
     for (int i = 0; i < octave; ++i) {
-        seedOffsetX.push_back(ofRandom(255));
-        seedOffsetY.push_back(ofRandom(255));
+        seedOffsetX.push_back(next(255));
+        seedOffsetY.push_back(next(255));
     }
 }
 
-std::vector<std::vector<float>> OctaveGenerator::generate(size_t size) {
-    std::vector<std::vector<float>> heightMap;
-    for (int y = 0; y <= size; y++) {
-        vector<float> row;
-        for (int x = 0; x <= size; x++)
-            row.push_back(0);
-        heightMap.push_back(row);
-    }
-    float x, y, z;
-    float freq, ampl;
+std::vector<NoiseMap> OctaveGeneratorBase::generateBatch(const std::vector<int>& seeds, size_t size) {
+    std::vector<NoiseMap> maps(seeds.size());
+    // Tiles of every map share the pool, so a few seeds still use every core
+    WorkerPool::shared().parallelFor(seeds.size(), [&](size_t index) {
+        const std::unique_ptr<OctaveGeneratorBase> generator = clone();
+        generator->reconfigure(true, octave, seeds[index]);
+        generator->generate(size, maps[index].heights);
+        maps[index].minNoise = generator->minNoise;
+        maps[index].maxNoise = generator->maxNoise;
+    });
+    return maps;
+}
 
-    if (_regen) {
+std::pair<float, float> OctaveGeneratorBase::generateTiles(size_t width, size_t height, HeightField& field, TileKernel kernel) {
+    ProfileScope profile(ProfileStage::Generate);
+    field.resize(width, height);
+
+    // Offsets come from a seeded RNG, so topping them up keeps the existing octaves intact
+    if (_regen || offsetSeed != seed || seedOffsetX.size() < static_cast<size_t>(octave)) {
         regenSeeds();
     }
-    minNoise = 1;
-    maxNoise = 0;
-    for (int i = 0; i <= size; ++i) {
-        for (int j = 0; j <= size; ++j) {
-            freq = 1;
-            ampl = 1;
-            z = 0;
-
-            for (int o = 0; o < octave; ++o) {
-                x = ((float)j - size / 2) / size / scale * freq + seedOffsetX.at(o);
-                y = ((float)i - size / 2) / size / scale * freq + seedOffsetY.at(o);
-                z += noise(x, y) * ampl;
 
-                freq *= lacunarity;
-                ampl *= persistence;
-            }
+    /*
+        Split the grid into cache-sized tiles and spread them over the worker pool.
+        Every point is computed the same way whichever thread gets it,
+        and min/max reduce exactly, so the result doesn't depend on thread count.
+    */
+    const size_t tilesX = (width + tileWidth - 1) / tileWidth;
+    const size_t tilesY = (height + tileHeight - 1) / tileHeight;
+    std::vector<std::pair<float, float>> tileRange(tilesX * tilesY);
 
-            if (z < minNoise) {
-                minNoise = z;
-            }
-            if (z > maxNoise) {
-                maxNoise = z;
-            }
-            heightMap.at(i).at(j) = z;
+    WorkerPool::shared().parallelFor(tileRange.size(), [&](size_t index) {
+        // Remaining tiles are skipped, not interrupted
+        if (cancel && cancel->load(std::memory_order_relaxed)) {
+            return;
         }
+        Tile tile;
+        tile.x0 = (index % tilesX) * tileWidth;
+        tile.x1 = std::min(tile.x0 + tileWidth, width);
+        tile.y0 = (index / tilesX) * tileHeight;
+        tile.y1 = std::min(tile.y0 + tileHeight, height);
+        tileRange[index] = kernel(tile);
+    });
+
+    std::pair<float, float> range(1.0f, 0.0f);
+    for (const auto& [tileMin, tileMax] : tileRange) {
+        range.first = std::min(range.first, tileMin);
+        range.second = std::max(range.second, tileMax);
     }
-    return heightMap;
+    return range;
 }
 
-float OctaveGenerator::getMinNoise() {
+float OctaveGeneratorBase::getMinNoise() {
     return minNoise;
 }
 
-float OctaveGenerator::getMaxNoise() {
+float OctaveGeneratorBase::getMaxNoise() {
     return maxNoise;
 }
\ No newline at end of file
@@ -1,26 +1,112 @@
 #pragma once
 #include <vector>
+#include <array>
+#include <atomic>
+#include <cstdint>
 #include <functional>
 #include <memory>
-#include "ofMain.h"
+#include <type_traits>
+#include <utility>
+#include <tuple>
+#include <string>
+#include <algorithm>
+#include "functionref.h"
+#include "heightfield.h"
+#include "noise.h"
+
+/*
+	Raw noise of one map with its range, as generate() + getMinNoise() / getMaxNoise() leave them.
+*/
+struct NoiseMap {
+	HeightField heights;
+	float minNoise = 1;
+	float maxNoise = 0;
+};
 
 class HeightGenerator {
 public:
 	/*
-		Pre-allocated squared matrix of size 'size' expected.
+		Fills 'heightMap' with (size + 1) x (size + 1) raw noise values.
+		The field is resized in place, its allocation is reused when possible.
 	*/
-	virtual std::vector<std::vector<float>> generate(size_t size) = 0;
+	virtual void generate(size_t size, HeightField& heightMap) = 0;
+	/*
+		Fills 'out' with width x height raw noise values for the points starting at (x0, y0)
+		of an unbounded grid sampled like generate(size): generate() equals the region at (0, 0).
+		Neighbouring regions agree on shared points, so regions can be stitched seamlessly.
+		Leaves getMinNoise() / getMaxNoise() untouched; getNoiseBound() bounds the values.
+	*/
+	virtual void generateRegion(long long x0, long long y0, size_t width, size_t height, size_t size, HeightField& out) = 0;
 	virtual void reconfigure(bool _regen = true, int octave = 8, int seed = 0) = 0;
+	/*
+		One map per seed, each equal to reconfigure(true, octave, seed) + generate(size)
+		with the current octave count. Seeds are generated concurrently;
+		this generator's own configuration and range are left untouched.
+	*/
+	virtual std::vector<NoiseMap> generateBatch(const std::vector<int>& seeds, size_t size) = 0;
+	/*
+		Once *cancel is set, generation may stop early and leave its output unspecified.
+		nullptr (the default) never cancels.
+	*/
+	virtual void setCancelFlag(const std::atomic<bool>* cancel) = 0;
 	virtual float getMinNoise() = 0;
 	virtual float getMaxNoise() = 0;
+	// Raw values always lie in [0; getNoiseBound()] for the current configuration
+	virtual float getNoiseBound() = 0;
+	/*
+		Identifies the algorithm and its fixed parameters: equal ids and equal
+		reconfigure() arguments give equal maps, so it keys on-disk caches.
+	*/
+	virtual std::string getId() = 0;
 	virtual ~HeightGenerator() = default;
 };
 
-class OctaveGenerator : public HeightGenerator {
+/*
+	Simplex noise as a generator policy: scalar call plus the batched SIMD kernel.
+*/
+struct SimplexNoise {
+	static constexpr const char* id = "simplex";
+	float operator()(float x, float y) const { return noise(x, y); }
+	static void batch(const float* xs, const float* ys, float* out, size_t n) { noise_batch(xs, ys, out, n); }
+};
+
+/*
+	Fractal parameters known at compile time.
+*/
+struct OctaveParams {
+	static constexpr float scale = 1.0f;
+	static constexpr float lacunarity = 2.0f;
+	static constexpr float persistence = 0.5f;
+	// Octave counts with a dedicated, fully unrolled tile kernel (GUI slider range)
+	static constexpr int maxUnrolled = 10;
+};
+
+/*
+	rand() as the MSVC runtime implements it, with the state kept in the object:
+	seeded like srand(), it replays the sequence ofSeedRandom() + ofRandom() used to give,
+	without the process-wide state that forced generators on different threads to take turns.
+*/
+class SeedRandom {
+public:
+	static constexpr int max = 0x7FFF;
+	static constexpr const char* id = "msvc-lcg";
+
+	explicit SeedRandom(int seed) : state{ static_cast<uint32_t>(seed) } {}
+	int next() {
+		state = state * 214013u + 2531011u;
+		return static_cast<int>((state >> 16) & max);
+	}
+
 private:
-	const float scale = 1.0f;
-	const float lacunarity = 2.0f;
-	const float persistence = 0.5f;
+	uint32_t state;
+};
+
+/*
+	Seeds, octave count and parallel tiling shared by every octave generator.
+	Noise-specific kernels live in BasicOctaveGenerator.
+*/
+class OctaveGeneratorBase : public HeightGenerator {
+protected:
 	bool _regen = true;
 	int octave = 8;
 	int seed = 0;
@@ -29,26 +115,205 @@ private:
 
 	std::vector<float> seedOffsetX;
 	std::vector<float> seedOffsetY;
-	std::function<float(float, float)> noise;
+	/*
+		Seed the offsets were drawn from. A map loaded from a cache skips generate(), so
+		'seed' can move on without them; _regen alone would then keep the old seed's offsets.
+	*/
+	int offsetSeed = 0;
+
+	const std::atomic<bool>* cancel = nullptr;
+
+	// Generation tile: 256 floats per row segment, 16 rows ~ 16KB of output
+	static constexpr size_t tileWidth = 256;
+	static constexpr size_t tileHeight = 16;
+
+	struct Tile {
+		size_t x0, x1;
+		size_t y0, y1;
+	};
+	// Fills one tile and returns its (min, max); only used during the call, so never copied to the heap
+	using TileKernel = FunctionRef<std::pair<float, float>(const Tile&)>;
 
 	void regenSeeds();
+	// Same configuration and offsets, for generating other seeds alongside this one
+	virtual std::unique_ptr<OctaveGeneratorBase> clone() const = 0;
+	// Resizes 'field' to width x height, runs 'kernel' over its tiles and returns the overall (min, max)
+	std::pair<float, float> generateTiles(size_t width, size_t height, HeightField& field, TileKernel kernel);
 
 public:
-	OctaveGenerator(std::function<float(float, float)> noise);
 	void reconfigure(bool _regen = true, int octave = 8, int seed = 0) override;
-	std::vector<std::vector<float>> generate(size_t size) override;
+	void setCancelFlag(const std::atomic<bool>* cancel) override;
+	std::vector<NoiseMap> generateBatch(const std::vector<int>& seeds, size_t size) override;
 	float getMinNoise() override;
 	float getMaxNoise() override;
 };
 
+/*
+	Octave generator specialised on the noise function and fractal parameters.
+	The octave count picks one of the unrolled kernels at runtime,
+	counts above Params::maxUnrolled run through the generic loop.
+*/
+template <typename NoiseFn, typename Params = OctaveParams>
+class BasicOctaveGenerator : public OctaveGeneratorBase {
+private:
+	NoiseFn noise;
+
+	template <typename F, typename = void>
+	struct HasBatch : std::false_type {};
+	template <typename F>
+	struct HasBatch<F, std::void_t<decltype(F::batch(nullptr, nullptr, nullptr, size_t()))>> : std::true_type {};
+
+	// Tile coordinates are relative to the field, (originX, originY) is the field's first grid point
+	template <int Octaves>
+	std::pair<float, float> generateTile(size_t size, long long originX, long long originY, HeightField& field, const Tile& tile) const;
+
+	using KernelPtr = std::pair<float, float> (BasicOctaveGenerator::*)(size_t, long long, long long, HeightField&, const Tile&) const;
+
+	template <int... O>
+	static KernelPtr pickKernel(int octave, std::integer_sequence<int, O...>) {
+		static const KernelPtr kernels[] = { &BasicOctaveGenerator::generateTile<O + 1>... };
+		return (octave >= 1 && octave <= static_cast<int>(sizeof...(O))) ? kernels[octave - 1] : &BasicOctaveGenerator::generateTile<0>;
+	}
+
+protected:
+	std::unique_ptr<OctaveGeneratorBase> clone() const override {
+		return std::make_unique<BasicOctaveGenerator>(*this);
+	}
+
+public:
+	explicit BasicOctaveGenerator(NoiseFn noise = NoiseFn()) : noise{ std::move(noise) } {}
+	void generate(size_t size, HeightField& heightMap) override;
+	void generateRegion(long long x0, long long y0, size_t width, size_t height, size_t size, HeightField& out) override;
+	float getNoiseBound() override;
+	std::string getId() override;
+};
+
+using OctaveGenerator = BasicOctaveGenerator<SimplexNoise>;
+
+template <typename NoiseFn, typename Params>
+void BasicOctaveGenerator<NoiseFn, Params>::generate(size_t size, HeightField& heightMap) {
+	const KernelPtr kernel = pickKernel(octave, std::make_integer_sequence<int, Params::maxUnrolled>());
+	std::tie(minNoise, maxNoise) = generateTiles(size + 1, size + 1, heightMap, [&](const Tile& tile) {
+		return (this->*kernel)(size, 0, 0, heightMap, tile);
+	});
+}
+
+template <typename NoiseFn, typename Params>
+void BasicOctaveGenerator<NoiseFn, Params>::generateRegion(long long x0, long long y0, size_t width, size_t height, size_t size, HeightField& out) {
+	const KernelPtr kernel = pickKernel(octave, std::make_integer_sequence<int, Params::maxUnrolled>());
+	generateTiles(width, height, out, [&](const Tile& tile) {
+		return (this->*kernel)(size, x0, y0, out, tile);
+	});
+}
+
+template <typename NoiseFn, typename Params>
+std::string BasicOctaveGenerator<NoiseFn, Params>::getId() {
+	return std::string("octave:") + NoiseFn::id
+		+ ":" + std::to_string(Params::scale)
+		+ ":" + std::to_string(Params::lacunarity)
+		+ ":" + std::to_string(Params::persistence)
+		+ ":" + SeedRandom::id;
+}
+
+template <typename NoiseFn, typename Params>
+float BasicOctaveGenerator<NoiseFn, Params>::getNoiseBound() {
+	// noise() is within [0; 1], so the octave sum is bounded by the sum of amplitudes
+	float bound = 0;
+	float ampl = 1;
+	for (int o = 0; o < octave; ++o) {
+		bound += ampl;
+		ampl *= Params::persistence;
+	}
+	return bound;
+}
+
+/*
+	Octaves == 0 is the generic kernel that reads the count at runtime.
+	Per point this does exactly what the scalar loop did:
+		x = ((float)j - size / 2) / size / scale * freq + offset
+		z += noise(x, y) * ampl
+	where j is the grid point (origin + tile offset), so the unrolled and batched kernels
+	give the same heights bit for bit, and so does any region covering the same points.
+*/
+template <typename NoiseFn, typename Params>
+template <int Octaves>
+std::pair<float, float> BasicOctaveGenerator<NoiseFn, Params>::generateTile(size_t size, long long originX, long long originY, HeightField& field, const Tile& tile) const {
+	const int octaves = Octaves > 0 ? Octaves : octave;
+	const size_t width = tile.x1 - tile.x0;
+
+	float freq[Octaves > 0 ? Octaves : 1];
+	float ampl[Octaves > 0 ? Octaves : 1];
+	std::vector<float> dynFreq, dynAmpl;
+	float* f = freq;
+	float* a = ampl;
+	if (Octaves == 0) {
+		dynFreq.resize(octaves);
+		dynAmpl.resize(octaves);
+		f = dynFreq.data();
+		a = dynAmpl.data();
+	}
+	float fo = 1;
+	float ao = 1;
+	for (int o = 0; o < octaves; ++o) {
+		f[o] = fo;
+		a[o] = ao;
+		fo *= Params::lacunarity;
+		ao *= Params::persistence;
+	}
+
+	float base[tileWidth];
+	float xs[tileWidth];
+	float ys[tileWidth];
+	float n[tileWidth];
+	for (size_t k = 0; k < width; ++k) {
+		base[k] = ((float)(originX + static_cast<long long>(tile.x0 + k)) - size / 2) / size / Params::scale;
+	}
+
+	float tileMin = 1;
+	float tileMax = 0;
+	for (size_t i = tile.y0; i < tile.y1; ++i) {
+		float* z = field.row(i) + tile.x0;
+		const float baseY = ((float)(originY + static_cast<long long>(i)) - size / 2) / size / Params::scale;
+		std::fill(z, z + width, 0.0f);
+
+		for (int o = 0; o < octaves; ++o) {
+			const float y = baseY * f[o] + seedOffsetY[o];
+			for (size_t k = 0; k < width; ++k) {
+				xs[k] = base[k] * f[o] + seedOffsetX[o];
+			}
+			if constexpr (HasBatch<NoiseFn>::value) {
+				std::fill(ys, ys + width, y);
+				NoiseFn::batch(xs, ys, n, width);
+			}
+			else {
+				for (size_t k = 0; k < width; ++k) {
+					n[k] = noise(xs[k], y);
+				}
+			}
+			for (size_t k = 0; k < width; ++k) {
+				z[k] += n[k] * a[o];
+			}
+		}
+
+		for (size_t k = 0; k < width; ++k) {
+			tileMin = std::min(tileMin, z[k]);
+			tileMax = std::max(tileMax, z[k]);
+		}
+	}
+	return { tileMin, tileMax };
+}
+
 class HeightGenerator_Creator {
 public:
-	virtual std::unique_ptr<HeightGenerator> create(std::function<float(float, float)> noise) = 0;
+	virtual std::unique_ptr<HeightGenerator> create() = 0;
 	virtual ~HeightGenerator_Creator() = default;
 };
 
-class OctaveGenerator_Creator : public HeightGenerator_Creator {
-	virtual std::unique_ptr<HeightGenerator> create(std::function<float(float, float)> noise) override {
-		return std::make_unique<OctaveGenerator>(std::move(noise));
+template <typename NoiseFn>
+class BasicOctaveGenerator_Creator : public HeightGenerator_Creator {
+	virtual std::unique_ptr<HeightGenerator> create() override {
+		return std::make_unique<BasicOctaveGenerator<NoiseFn>>();
 	}
-};
\ No newline at end of file
+};
+
+using OctaveGenerator_Creator = BasicOctaveGenerator_Creator<SimplexNoise>;
@@ -0,0 +1,173 @@
+#include "heightfield.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#if defined(_M_X64) || defined(__x86_64__)
+#define FJ_DEQUANTIZE_SSE2 1
+#include <emmintrin.h>
+#else
+#define FJ_DEQUANTIZE_SSE2 0
+#endif
+
+namespace {
+
+// quantized * scale + offset, 8 samples per step; the tail rounds exactly like the vector part
+void dequantize(const uint16_t* in, size_t count, float scale, float offset, float* out) {
+    size_t k = 0;
+#if FJ_DEQUANTIZE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 scales = _mm_set1_ps(scale);
+    const __m128 offsets = _mm_set1_ps(offset);
+    for (; k + 8 <= count; k += 8) {
+        const __m128i q = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + k));
+        const __m128 low = _mm_cvtepi32_ps(_mm_unpacklo_epi16(q, zero));
+        const __m128 high = _mm_cvtepi32_ps(_mm_unpackhi_epi16(q, zero));
+        _mm_storeu_ps(out + k, _mm_add_ps(_mm_mul_ps(low, scales), offsets));
+        _mm_storeu_ps(out + k + 4, _mm_add_ps(_mm_mul_ps(high, scales), offsets));
+    }
+#endif
+    for (; k < count; ++k) {
+        out[k] = in[k] * scale + offset;
+    }
+}
+
+// See HeightField::scroll(); rows are visited so none is overwritten before it's read
+template <typename T>
+void scrollRows(T* data, size_t stride, size_t width, size_t height, long long dx, long long dy) {
+    const long long w = static_cast<long long>(width);
+    const long long h = static_cast<long long>(height);
+    if (dx <= -w || dx >= w || dy <= -h || dy >= h || (dx == 0 && dy == 0)) {
+        return;
+    }
+    const size_t columns = static_cast<size_t>(w - std::abs(dx));
+    const size_t to = dx < 0 ? static_cast<size_t>(-dx) : 0;
+    const size_t from = dx > 0 ? static_cast<size_t>(dx) : 0;
+    auto move = [&](long long y) {
+        std::memmove(data + y * stride + to, data + (y + dy) * stride + from, columns * sizeof(T));
+    };
+    if (dy > 0) {
+        for (long long y = 0; y + dy < h; ++y) {
+            move(y);
+        }
+    }
+    else {
+        for (long long y = h - 1; y + dy >= 0; --y) {
+            move(y);
+        }
+    }
+}
+
+}
+
+const float* HeightFieldView::readRow(size_t y, size_t x, size_t count, float* buffer) const {
+    if (!quantized) {
+        return data + y * stride + x;
+    }
+    dequantize(quantized + y * stride + x, count, scale, offset, buffer);
+    return buffer;
+}
+
+HeightFieldView HeightFieldView::sub(size_t x, size_t y, size_t w, size_t h) const {
+    HeightFieldView v = *this;
+    if (quantized) {
+        v.quantized = quantized + y * stride + x;
+    }
+    else {
+        v.data = data + y * stride + x;
+    }
+    v.width = w;
+    v.height = h;
+    return v;
+}
+
+void HeightField::AlignedDelete::operator()(float* p) const {
+    ::operator delete[](p, std::align_val_t{ alignment });
+}
+
+HeightField::HeightField(size_t width, size_t height) {
+    resize(width, height);
+}
+
+void HeightField::resize(size_t width, size_t height) {
+    // Pad rows up to a whole number of cache lines
+    const size_t perLine = alignment / sizeof(float);
+    const size_t stride = (width + perLine - 1) / perLine * perLine;
+    const size_t required = stride * height;
+
+    if (required > capacity) {
+        data.reset(static_cast<float*>(::operator new[](required * sizeof(float), std::align_val_t{ alignment })));
+        capacity = required;
+    }
+    this->width = width;
+    this->height = height;
+    this->stride = stride;
+}
+
+void HeightField::fill(float value) {
+    std::fill(data.get(), data.get() + stride * height, value);
+}
+
+void HeightField::scroll(long long dx, long long dy) {
+    scrollRows(data.get(), stride, width, height, dx, dy);
+}
+
+HeightFieldView HeightField::view() const {
+    HeightFieldView v;
+    v.data = data.get();
+    v.width = width;
+    v.height = height;
+    v.stride = stride;
+    return v;
+}
+
+void QuantizedHeightField::AlignedDelete::operator()(uint16_t* p) const {
+    ::operator delete[](p, std::align_val_t{ alignment });
+}
+
+void QuantizedHeightField::resize(size_t width, size_t height) {
+    const size_t perLine = alignment / sizeof(uint16_t);
+    const size_t stride = (width + perLine - 1) / perLine * perLine;
+    const size_t required = stride * height;
+
+    if (required > capacity) {
+        data.reset(static_cast<uint16_t*>(::operator new[](required * sizeof(uint16_t), std::align_val_t{ alignment })));
+        capacity = required;
+    }
+    this->width = width;
+    this->height = height;
+    this->stride = stride;
+}
+
+void QuantizedHeightField::setRange(float low, float high) {
+    offset = low;
+    scale = high > low ? (high - low) / 65535.0f : 0.0f;
+}
+
+void QuantizedHeightField::storeRow(size_t y, size_t x, size_t count, const float* heights) {
+    uint16_t* out = data.get() + y * stride + x;
+    const float inverse = scale > 0.0f ? 1.0f / scale : 0.0f;
+    for (size_t k = 0; k < count; ++k) {
+        float v = (heights[k] - offset) * inverse;
+        if (!(v > 0.0f)) {
+            v = 0.0f;
+        }
+        out[k] = static_cast<uint16_t>(std::min(v, 65535.0f) + 0.5f);
+    }
+}
+
+void QuantizedHeightField::scroll(long long dx, long long dy) {
+    scrollRows(data.get(), stride, width, height, dx, dy);
+}
+
+HeightFieldView QuantizedHeightField::view() const {
+    HeightFieldView v;
+    v.quantized = data.get();
+    v.scale = scale;
+    v.offset = offset;
+    v.width = width;
+    v.height = height;
+    v.stride = stride;
+    return v;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/*
+	Borrowed read-only window into a row-major height map.
+	Owns nothing: stays valid while the source HeightField is alive and not resized.
+	A 16-bit map (see QuantizedHeightField) sets 'quantized' instead of 'data';
+	at() and readRow() read either kind, row() only float maps.
+*/
+struct HeightFieldView {
+	const float* data = nullptr;
+	// Height = quantized * scale + offset
+	const uint16_t* quantized = nullptr;
+	float scale = 1.0f;
+	float offset = 0.0f;
+	size_t width = 0;
+	size_t height = 0;
+	size_t stride = 0; // distance between rows, in samples
+
+	const float* row(size_t y) const { return data + y * stride; }
+	float at(size_t x, size_t y) const {
+		return quantized ? quantized[y * stride + x] * scale + offset : data[y * stride + x];
+	}
+	/*
+		Heights [x; x + count) of row y: a pointer into the map for float maps,
+		otherwise dequantized into 'buffer', which must hold 'count' floats.
+	*/
+	const float* readRow(size_t y, size_t x, size_t count, float* buffer) const;
+	bool isQuantized() const { return quantized != nullptr; }
+	bool empty() const { return (data == nullptr && quantized == nullptr) || width == 0 || height == 0; }
+
+	HeightFieldView sub(size_t x, size_t y, size_t w, size_t h) const;
+};
+
+/*
+	Row-major height map stored in a single cache-aligned allocation.
+	Every row starts on a cache line; 'stride' includes the padding.
+	Move-only, so a map lives in memory once and is handed out as HeightFieldView.
+*/
+class HeightField {
+public:
+	static constexpr size_t alignment = 64;
+
+	HeightField() = default;
+	HeightField(size_t width, size_t height);
+	HeightField(HeightField&&) noexcept = default;
+	HeightField& operator=(HeightField&&) noexcept = default;
+	HeightField(const HeightField&) = delete;
+	HeightField& operator=(const HeightField&) = delete;
+
+	/*
+		Contents are unspecified after resize.
+		Allocation is reused while it's large enough.
+	*/
+	void resize(size_t width, size_t height);
+	void fill(float value);
+	/*
+		Moves the contents in place so point (x, y) holds what (x + dx, y + dy) held.
+		Points whose source lies outside the map are unspecified.
+	*/
+	void scroll(long long dx, long long dy);
+
+	float* row(size_t y) { return data.get() + y * stride; }
+	const float* row(size_t y) const { return data.get() + y * stride; }
+	float& at(size_t x, size_t y) { return data[y * stride + x]; }
+	float at(size_t x, size_t y) const { return data[y * stride + x]; }
+
+	size_t getWidth() const { return width; }
+	size_t getHeight() const { return height; }
+	size_t getStride() const { return stride; }
+	bool empty() const { return width == 0 || height == 0; }
+
+	HeightFieldView view() const;
+
+private:
+	struct AlignedDelete {
+		void operator()(float* p) const;
+	};
+
+	std::unique_ptr<float[], AlignedDelete> data;
+	size_t width = 0;
+	size_t height = 0;
+	size_t stride = 0;
+	size_t capacity = 0;
+};
+
+/*
+	Height map stored as uint16 over [low; high], half the size of a HeightField.
+	Same row layout: cache-aligned rows, 'stride' in samples. Heights outside the range clamp.
+	A range of a few thousand gives steps of a few hundredths, far below what a frame can show.
+*/
+class QuantizedHeightField {
+public:
+	static constexpr size_t alignment = HeightField::alignment;
+
+	QuantizedHeightField() = default;
+	QuantizedHeightField(QuantizedHeightField&&) noexcept = default;
+	QuantizedHeightField& operator=(QuantizedHeightField&&) noexcept = default;
+	QuantizedHeightField(const QuantizedHeightField&) = delete;
+	QuantizedHeightField& operator=(const QuantizedHeightField&) = delete;
+
+	// Contents are unspecified after resize; allocation is reused while it's large enough
+	void resize(size_t width, size_t height);
+	// Sets the range rows are quantized over; call before storing any
+	void setRange(float low, float high);
+	// Quantizes 'count' heights into row y from column x on
+	void storeRow(size_t y, size_t x, size_t count, const float* heights);
+	// See HeightField::scroll()
+	void scroll(long long dx, long long dy);
+
+	const uint16_t* row(size_t y) const { return data.get() + y * stride; }
+	float at(size_t x, size_t y) const { return data[y * stride + x] * scale + offset; }
+
+	size_t getWidth() const { return width; }
+	size_t getHeight() const { return height; }
+	size_t getStride() const { return stride; }
+	float getScale() const { return scale; }
+	float getOffset() const { return offset; }
+	bool empty() const { return width == 0 || height == 0; }
+
+	HeightFieldView view() const;
+
+private:
+	struct AlignedDelete {
+		void operator()(uint16_t* p) const;
+	};
+
+	std::unique_ptr<uint16_t[], AlignedDelete> data;
+	size_t width = 0;
+	size_t height = 0;
+	size_t stride = 0;
+	size_t capacity = 0;
+	float scale = 1.0f;
+	float offset = 0.0f;
+};
@@ -0,0 +1,172 @@
+#include "mapfile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char fileMagic[8] = { 'F', 'J', 'H', 'M', 'A', 'P', 0, 0 };
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+}
+
+HeightMapHeader makeHeightMapHeader(int seed, int octave, size_t size, float minNoise, float maxNoise, const std::string& generator) {
+    HeightMapHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+    header.version = HeightMapHeader::currentVersion;
+    header.headerSize = sizeof(HeightMapHeader);
+    header.seed = seed;
+    header.octave = octave;
+    header.size = size;
+    header.minNoise = minNoise;
+    header.maxNoise = maxNoise;
+    std::strncpy(header.generator, generator.c_str(), sizeof(header.generator) - 1);
+    return header;
+}
+
+bool saveHeightMap(const std::string& path, HeightMapHeader header, const HeightFieldView& data) {
+    header.width = data.width;
+    header.height = data.height;
+    // Same row padding as HeightField, so the mapped rows keep their cache line alignment
+    header.stride = alignUp(data.width, HeightField::alignment / sizeof(float));
+    header.dataOffset = alignUp(sizeof(HeightMapHeader), HeightMapHeader::dataAlignment);
+
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            return false;
+        }
+        std::vector<char> padding(static_cast<size_t>(std::max<uint64_t>(header.dataOffset - sizeof(header), (header.stride - data.width) * sizeof(float))), 0);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(padding.data(), header.dataOffset - sizeof(header));
+        for (size_t y = 0; y < data.height; ++y) {
+            out.write(reinterpret_cast<const char*>(data.row(y)), data.width * sizeof(float));
+            out.write(padding.data(), (header.stride - data.width) * sizeof(float));
+        }
+        if (!out.flush()) {
+            out.close();
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<MappedHeightMap> MappedHeightMap::open(const std::string& path) {
+    std::unique_ptr<MappedHeightMap> map(new MappedHeightMap());
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+    map->file = file;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < static_cast<LONGLONG>(sizeof(HeightMapHeader))) {
+        return nullptr;
+    }
+    map->mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!map->mapping) {
+        return nullptr;
+    }
+    map->base = static_cast<const unsigned char*>(MapViewOfFile(map->mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!map->base) {
+        return nullptr;
+    }
+    map->length = static_cast<size_t>(fileSize.QuadPart);
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(HeightMapHeader))) {
+        ::close(fd);
+        return nullptr;
+    }
+    void* base = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps the file alive
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        return nullptr;
+    }
+    map->base = static_cast<const unsigned char*>(base);
+    map->length = static_cast<size_t>(info.st_size);
+    // Maps are read front to back by Fjord::applyMapType()
+    madvise(base, map->length, MADV_SEQUENTIAL);
+#endif
+
+    HeightMapHeader& h = map->header;
+    std::memcpy(&h, map->base, sizeof(h));
+    bool valid = std::memcmp(h.magic, fileMagic, sizeof(fileMagic)) == 0
+        && h.version == HeightMapHeader::currentVersion
+        && h.headerSize == sizeof(HeightMapHeader)
+        && h.dataOffset % HeightMapHeader::dataAlignment == 0
+        && h.dataOffset >= sizeof(HeightMapHeader)
+        && h.dataOffset <= map->length
+        && h.stride > 0
+        && h.stride >= h.width
+        && h.generator[sizeof(h.generator) - 1] == 0;
+    if (valid) {
+        const uint64_t rows = (map->length - h.dataOffset) / (h.stride * sizeof(float));
+        valid = h.height <= rows;
+    }
+    if (!valid) {
+        return nullptr;
+    }
+    return map;
+}
+
+MappedHeightMap::~MappedHeightMap() {
+#ifdef _WIN32
+    if (base) {
+        UnmapViewOfFile(base);
+    }
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+    if (file) {
+        CloseHandle(file);
+    }
+#else
+    if (base) {
+        munmap(const_cast<unsigned char*>(base), length);
+    }
+#endif
+}
+
+HeightFieldView MappedHeightMap::view() const {
+    HeightFieldView v;
+    v.data = reinterpret_cast<const float*>(base + header.dataOffset);
+    v.width = static_cast<size_t>(header.width);
+    v.height = static_cast<size_t>(header.height);
+    v.stride = static_cast<size_t>(header.stride);
+    return v;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "heightfield.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/*
+	On-disk height map, version 1, little-endian:
+		HeightMapHeader, zero padding up to dataOffset,
+		then 'height' rows of 'stride' floats (the first 'width' of each are used).
+	dataOffset is a multiple of dataAlignment, so a mapped file can be read in place
+	with the same row alignment a HeightField has.
+*/
+struct HeightMapHeader {
+	static constexpr uint32_t currentVersion = 1;
+	static constexpr uint64_t dataAlignment = 4096;
+
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+	int32_t seed;
+	int32_t octave;
+	uint64_t size;
+	uint64_t width;
+	uint64_t height;
+	uint64_t stride;
+	uint64_t dataOffset;
+	float minNoise;
+	float maxNoise;
+	// NUL-terminated HeightGenerator::getId() of the generator that produced the data
+	char generator[64];
+};
+static_assert(sizeof(HeightMapHeader) == 136, "HeightMapHeader layout is part of the file format");
+
+/*
+	Header describing a generated map; the layout fields are filled in by saveHeightMap().
+*/
+HeightMapHeader makeHeightMapHeader(int seed, int octave, size_t size, float minNoise, float maxNoise, const std::string& generator);
+
+/*
+	Writes through a temporary file and renames it into place,
+	so readers never see a partial map. Returns false on any I/O error.
+*/
+bool saveHeightMap(const std::string& path, HeightMapHeader header, const HeightFieldView& data);
+
+/*
+	Read-only memory mapping of a height map file.
+	Opening validates the header and file length only; pages are read in on first access.
+*/
+class MappedHeightMap {
+private:
+	HeightMapHeader header;
+	const unsigned char* base = nullptr;
+	size_t length = 0;
+#ifdef _WIN32
+	void* file = nullptr;
+	void* mapping = nullptr;
+#endif
+
+	MappedHeightMap() = default;
+
+public:
+	~MappedHeightMap();
+	MappedHeightMap(const MappedHeightMap&) = delete;
+	MappedHeightMap& operator=(const MappedHeightMap&) = delete;
+
+	// nullptr if the file is missing, truncated or not a supported height map
+	static std::unique_ptr<MappedHeightMap> open(const std::string& path);
+
+	const HeightMapHeader& getHeader() const { return header; }
+	// Valid while this object is alive
+	HeightFieldView view() const;
+};
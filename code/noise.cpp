@@ -22,9 +22,9 @@ const uint8_t perm[256] = {
     138, 236, 205, 93, 222, 114, 67, 29, 24, 72, 243, 141, 128, 195, 78, 66, 215, 61, 156, 180
 };
 
+// Wraps like i mod 256 for negative i too, without the signed remainder
 uint8_t hashit(int32_t i) {
-    i %= 256;
-    return perm[static_cast<uint8_t>(i)];
+    return perm[static_cast<uint32_t>(i) & 0xFF];
 }
 
 // Generate pseudo-random vector in (x, y)
@@ -111,4 +111,320 @@ float noise(float x, float y) {
     }
 
     return (45.23065f * (n0 + n1 + n2) + 1.0f) / 2.0f;
-}
\ No newline at end of file
+}
+
+/*
+    Batched SIMD kernels.
+    Each one is a lane-wise copy of noise() above: same constants, same order of
+    float operations, no FMA. Hashes use a widened copy of 'perm' so lanes can be gathered.
+*/
+#if defined(_M_X64) || defined(__x86_64__)
+#define FJ_NOISE_SIMD 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define FJ_TARGET(isa)
+#elif defined(__clang__)
+#include <cpuid.h>
+#define FJ_TARGET(isa) __attribute__((target(isa)))
+#else
+// GCC would otherwise fuse mul/add intrinsics into FMA under AVX-512 and break bit-exactness
+#include <cpuid.h>
+#define FJ_TARGET(isa) __attribute__((target(isa), optimize("fp-contract=off")))
+#endif
+#else
+#define FJ_NOISE_SIMD 0
+#endif
+
+namespace {
+
+using NoiseBatchFn = void (*)(const float*, const float*, float*, size_t);
+
+void noise_batch_scalar(const float* xs, const float* ys, float* out, size_t n) {
+    for (size_t k = 0; k < n; ++k) {
+        out[k] = noise(xs[k], ys[k]);
+    }
+}
+
+#if FJ_NOISE_SIMD
+
+struct Perm32 {
+    alignas(64) int32_t v[256];
+    Perm32() {
+        for (int k = 0; k < 256; ++k) {
+            v[k] = perm[k];
+        }
+    }
+};
+
+const int32_t* perm32() {
+    static const Perm32 table;
+    return table.v;
+}
+
+const float F2 = 0.366025403f;
+const float G2 = 0.211324865f;
+
+FJ_TARGET("sse4.2")
+inline __m128i gather_sse42(const int32_t* table, __m128i idx) {
+    alignas(16) int32_t lanes[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), idx);
+    return _mm_setr_epi32(table[lanes[0]], table[lanes[1]], table[lanes[2]], table[lanes[3]]);
+}
+
+// Contribution of one simplex corner: t = 0.5 - x^2 - y^2; t < 0 ? 0 : t^4 * grad(h, x, y)
+FJ_TARGET("sse4.2")
+inline __m128 corner_sse42(__m128i h, __m128 x, __m128 y) {
+    h = _mm_and_si128(h, _mm_set1_epi32(0x3F));
+    const __m128 lt4 = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(4)));
+    const __m128 u = _mm_blendv_ps(y, x, lt4);
+    const __m128 v = _mm_mul_ps(_mm_set1_ps(2.0f), _mm_blendv_ps(x, y, lt4));
+    const __m128 su = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(1)), 31));
+    const __m128 sv = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(2)), 30));
+    const __m128 g = _mm_add_ps(_mm_xor_ps(u, su), _mm_xor_ps(v, sv));
+
+    __m128 t = _mm_sub_ps(_mm_sub_ps(_mm_set1_ps(0.5f), _mm_mul_ps(x, x)), _mm_mul_ps(y, y));
+    const __m128 negative = _mm_cmplt_ps(t, _mm_setzero_ps());
+    t = _mm_mul_ps(t, t);
+    return _mm_andnot_ps(negative, _mm_mul_ps(_mm_mul_ps(t, t), g));
+}
+
+FJ_TARGET("sse4.2")
+void noise_batch_sse42(const float* xs, const float* ys, float* out, size_t n) {
+    const int32_t* p = perm32();
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i mask = _mm_set1_epi32(255);
+    size_t k = 0;
+    for (; k + 4 <= n; k += 4) {
+        const __m128 x = _mm_loadu_ps(xs + k);
+        const __m128 y = _mm_loadu_ps(ys + k);
+
+        const __m128 s = _mm_mul_ps(_mm_add_ps(x, y), _mm_set1_ps(F2));
+        const __m128 xsk = _mm_add_ps(x, s);
+        const __m128 ysk = _mm_add_ps(y, s);
+        __m128i i = _mm_cvttps_epi32(xsk);
+        __m128i j = _mm_cvttps_epi32(ysk);
+        i = _mm_add_epi32(i, _mm_castps_si128(_mm_cmplt_ps(xsk, _mm_cvtepi32_ps(i))));
+        j = _mm_add_epi32(j, _mm_castps_si128(_mm_cmplt_ps(ysk, _mm_cvtepi32_ps(j))));
+
+        const __m128 t = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(i, j)), _mm_set1_ps(G2));
+        const __m128 x0 = _mm_sub_ps(x, _mm_sub_ps(_mm_cvtepi32_ps(i), t));
+        const __m128 y0 = _mm_sub_ps(y, _mm_sub_ps(_mm_cvtepi32_ps(j), t));
+
+        // x0 > y0 ? (1, 0) : (0, 1)
+        const __m128i upper = _mm_castps_si128(_mm_cmpgt_ps(x0, y0));
+        const __m128i i1 = _mm_and_si128(upper, one);
+        const __m128i j1 = _mm_andnot_si128(upper, one);
+
+        const __m128 x1 = _mm_add_ps(_mm_sub_ps(x0, _mm_cvtepi32_ps(i1)), _mm_set1_ps(G2));
+        const __m128 y1 = _mm_add_ps(_mm_sub_ps(y0, _mm_cvtepi32_ps(j1)), _mm_set1_ps(G2));
+        const __m128 x2 = _mm_add_ps(_mm_sub_ps(x0, _mm_set1_ps(1.0f)), _mm_set1_ps(2.0f * G2));
+        const __m128 y2 = _mm_add_ps(_mm_sub_ps(y0, _mm_set1_ps(1.0f)), _mm_set1_ps(2.0f * G2));
+
+        const __m128i hj0 = gather_sse42(p, _mm_and_si128(j, mask));
+        const __m128i hj1 = gather_sse42(p, _mm_and_si128(_mm_add_epi32(j, j1), mask));
+        const __m128i hj2 = gather_sse42(p, _mm_and_si128(_mm_add_epi32(j, one), mask));
+        const __m128i gi0 = gather_sse42(p, _mm_and_si128(_mm_add_epi32(i, hj0), mask));
+        const __m128i gi1 = gather_sse42(p, _mm_and_si128(_mm_add_epi32(_mm_add_epi32(i, i1), hj1), mask));
+        const __m128i gi2 = gather_sse42(p, _mm_and_si128(_mm_add_epi32(_mm_add_epi32(i, one), hj2), mask));
+
+        const __m128 n = _mm_add_ps(_mm_add_ps(corner_sse42(gi0, x0, y0), corner_sse42(gi1, x1, y1)), corner_sse42(gi2, x2, y2));
+        const __m128 r = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(45.23065f), n), _mm_set1_ps(1.0f)), _mm_set1_ps(0.5f));
+        _mm_storeu_ps(out + k, r);
+    }
+    noise_batch_scalar(xs + k, ys + k, out + k, n - k);
+}
+
+FJ_TARGET("avx2")
+inline __m256 corner_avx2(__m256i h, __m256 x, __m256 y) {
+    h = _mm256_and_si256(h, _mm256_set1_epi32(0x3F));
+    const __m256 lt4 = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(4), h));
+    const __m256 u = _mm256_blendv_ps(y, x, lt4);
+    const __m256 v = _mm256_mul_ps(_mm256_set1_ps(2.0f), _mm256_blendv_ps(x, y, lt4));
+    const __m256 su = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(1)), 31));
+    const __m256 sv = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(2)), 30));
+    const __m256 g = _mm256_add_ps(_mm256_xor_ps(u, su), _mm256_xor_ps(v, sv));
+
+    __m256 t = _mm256_sub_ps(_mm256_sub_ps(_mm256_set1_ps(0.5f), _mm256_mul_ps(x, x)), _mm256_mul_ps(y, y));
+    const __m256 negative = _mm256_cmp_ps(t, _mm256_setzero_ps(), _CMP_LT_OQ);
+    t = _mm256_mul_ps(t, t);
+    return _mm256_andnot_ps(negative, _mm256_mul_ps(_mm256_mul_ps(t, t), g));
+}
+
+FJ_TARGET("avx2")
+void noise_batch_avx2(const float* xs, const float* ys, float* out, size_t n) {
+    const int32_t* p = perm32();
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i mask = _mm256_set1_epi32(255);
+    size_t k = 0;
+    for (; k + 8 <= n; k += 8) {
+        const __m256 x = _mm256_loadu_ps(xs + k);
+        const __m256 y = _mm256_loadu_ps(ys + k);
+
+        const __m256 s = _mm256_mul_ps(_mm256_add_ps(x, y), _mm256_set1_ps(F2));
+        const __m256 xsk = _mm256_add_ps(x, s);
+        const __m256 ysk = _mm256_add_ps(y, s);
+        __m256i i = _mm256_cvttps_epi32(xsk);
+        __m256i j = _mm256_cvttps_epi32(ysk);
+        i = _mm256_add_epi32(i, _mm256_castps_si256(_mm256_cmp_ps(xsk, _mm256_cvtepi32_ps(i), _CMP_LT_OQ)));
+        j = _mm256_add_epi32(j, _mm256_castps_si256(_mm256_cmp_ps(ysk, _mm256_cvtepi32_ps(j), _CMP_LT_OQ)));
+
+        const __m256 t = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(i, j)), _mm256_set1_ps(G2));
+        const __m256 x0 = _mm256_sub_ps(x, _mm256_sub_ps(_mm256_cvtepi32_ps(i), t));
+        const __m256 y0 = _mm256_sub_ps(y, _mm256_sub_ps(_mm256_cvtepi32_ps(j), t));
+
+        const __m256i upper = _mm256_castps_si256(_mm256_cmp_ps(x0, y0, _CMP_GT_OQ));
+        const __m256i i1 = _mm256_and_si256(upper, one);
+        const __m256i j1 = _mm256_andnot_si256(upper, one);
+
+        const __m256 x1 = _mm256_add_ps(_mm256_sub_ps(x0, _mm256_cvtepi32_ps(i1)), _mm256_set1_ps(G2));
+        const __m256 y1 = _mm256_add_ps(_mm256_sub_ps(y0, _mm256_cvtepi32_ps(j1)), _mm256_set1_ps(G2));
+        const __m256 x2 = _mm256_add_ps(_mm256_sub_ps(x0, _mm256_set1_ps(1.0f)), _mm256_set1_ps(2.0f * G2));
+        const __m256 y2 = _mm256_add_ps(_mm256_sub_ps(y0, _mm256_set1_ps(1.0f)), _mm256_set1_ps(2.0f * G2));
+
+        const __m256i hj0 = _mm256_i32gather_epi32(p, _mm256_and_si256(j, mask), 4);
+        const __m256i hj1 = _mm256_i32gather_epi32(p, _mm256_and_si256(_mm256_add_epi32(j, j1), mask), 4);
+        const __m256i hj2 = _mm256_i32gather_epi32(p, _mm256_and_si256(_mm256_add_epi32(j, one), mask), 4);
+        const __m256i gi0 = _mm256_i32gather_epi32(p, _mm256_and_si256(_mm256_add_epi32(i, hj0), mask), 4);
+        const __m256i gi1 = _mm256_i32gather_epi32(p, _mm256_and_si256(_mm256_add_epi32(_mm256_add_epi32(i, i1), hj1), mask), 4);
+        const __m256i gi2 = _mm256_i32gather_epi32(p, _mm256_and_si256(_mm256_add_epi32(_mm256_add_epi32(i, one), hj2), mask), 4);
+
+        const __m256 n = _mm256_add_ps(_mm256_add_ps(corner_avx2(gi0, x0, y0), corner_avx2(gi1, x1, y1)), corner_avx2(gi2, x2, y2));
+        const __m256 r = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(45.23065f), n), _mm256_set1_ps(1.0f)), _mm256_set1_ps(0.5f));
+        _mm256_storeu_ps(out + k, r);
+    }
+    noise_batch_scalar(xs + k, ys + k, out + k, n - k);
+}
+
+FJ_TARGET("avx512f")
+inline __m512 corner_avx512(__m512i h, __m512 x, __m512 y) {
+    h = _mm512_and_si512(h, _mm512_set1_epi32(0x3F));
+    const __mmask16 lt4 = _mm512_cmplt_epi32_mask(h, _mm512_set1_epi32(4));
+    const __m512 u = _mm512_mask_blend_ps(lt4, y, x);
+    const __m512 v = _mm512_mul_ps(_mm512_set1_ps(2.0f), _mm512_mask_blend_ps(lt4, x, y));
+    const __m512i su = _mm512_slli_epi32(_mm512_and_si512(h, _mm512_set1_epi32(1)), 31);
+    const __m512i sv = _mm512_slli_epi32(_mm512_and_si512(h, _mm512_set1_epi32(2)), 30);
+    const __m512 g = _mm512_add_ps(
+        _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(u), su)),
+        _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(v), sv)));
+
+    __m512 t = _mm512_sub_ps(_mm512_sub_ps(_mm512_set1_ps(0.5f), _mm512_mul_ps(x, x)), _mm512_mul_ps(y, y));
+    const __mmask16 nonNegative = _mm512_cmp_ps_mask(t, _mm512_setzero_ps(), _CMP_NLT_UQ);
+    t = _mm512_mul_ps(t, t);
+    return _mm512_maskz_mov_ps(nonNegative, _mm512_mul_ps(_mm512_mul_ps(t, t), g));
+}
+
+FJ_TARGET("avx512f")
+void noise_batch_avx512(const float* xs, const float* ys, float* out, size_t n) {
+    const int32_t* p = perm32();
+    const __m512i one = _mm512_set1_epi32(1);
+    const __m512i mask = _mm512_set1_epi32(255);
+    size_t k = 0;
+    for (; k + 16 <= n; k += 16) {
+        const __m512 x = _mm512_loadu_ps(xs + k);
+        const __m512 y = _mm512_loadu_ps(ys + k);
+
+        const __m512 s = _mm512_mul_ps(_mm512_add_ps(x, y), _mm512_set1_ps(F2));
+        const __m512 xsk = _mm512_add_ps(x, s);
+        const __m512 ysk = _mm512_add_ps(y, s);
+        __m512i i = _mm512_cvttps_epi32(xsk);
+        __m512i j = _mm512_cvttps_epi32(ysk);
+        i = _mm512_mask_sub_epi32(i, _mm512_cmp_ps_mask(xsk, _mm512_cvtepi32_ps(i), _CMP_LT_OQ), i, one);
+        j = _mm512_mask_sub_epi32(j, _mm512_cmp_ps_mask(ysk, _mm512_cvtepi32_ps(j), _CMP_LT_OQ), j, one);
+
+        const __m512 t = _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_add_epi32(i, j)), _mm512_set1_ps(G2));
+        const __m512 x0 = _mm512_sub_ps(x, _mm512_sub_ps(_mm512_cvtepi32_ps(i), t));
+        const __m512 y0 = _mm512_sub_ps(y, _mm512_sub_ps(_mm512_cvtepi32_ps(j), t));
+
+        const __mmask16 upper = _mm512_cmp_ps_mask(x0, y0, _CMP_GT_OQ);
+        const __m512i i1 = _mm512_maskz_mov_epi32(upper, one);
+        const __m512i j1 = _mm512_maskz_mov_epi32(static_cast<__mmask16>(~upper), one);
+
+        const __m512 x1 = _mm512_add_ps(_mm512_sub_ps(x0, _mm512_cvtepi32_ps(i1)), _mm512_set1_ps(G2));
+        const __m512 y1 = _mm512_add_ps(_mm512_sub_ps(y0, _mm512_cvtepi32_ps(j1)), _mm512_set1_ps(G2));
+        const __m512 x2 = _mm512_add_ps(_mm512_sub_ps(x0, _mm512_set1_ps(1.0f)), _mm512_set1_ps(2.0f * G2));
+        const __m512 y2 = _mm512_add_ps(_mm512_sub_ps(y0, _mm512_set1_ps(1.0f)), _mm512_set1_ps(2.0f * G2));
+
+        const __m512i hj0 = _mm512_i32gather_epi32(_mm512_and_si512(j, mask), p, 4);
+        const __m512i hj1 = _mm512_i32gather_epi32(_mm512_and_si512(_mm512_add_epi32(j, j1), mask), p, 4);
+        const __m512i hj2 = _mm512_i32gather_epi32(_mm512_and_si512(_mm512_add_epi32(j, one), mask), p, 4);
+        const __m512i gi0 = _mm512_i32gather_epi32(_mm512_and_si512(_mm512_add_epi32(i, hj0), mask), p, 4);
+        const __m512i gi1 = _mm512_i32gather_epi32(_mm512_and_si512(_mm512_add_epi32(_mm512_add_epi32(i, i1), hj1), mask), p, 4);
+        const __m512i gi2 = _mm512_i32gather_epi32(_mm512_and_si512(_mm512_add_epi32(_mm512_add_epi32(i, one), hj2), mask), p, 4);
+
+        const __m512 n = _mm512_add_ps(_mm512_add_ps(corner_avx512(gi0, x0, y0), corner_avx512(gi1, x1, y1)), corner_avx512(gi2, x2, y2));
+        const __m512 r = _mm512_mul_ps(_mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(45.23065f), n), _mm512_set1_ps(1.0f)), _mm512_set1_ps(0.5f));
+        _mm512_storeu_ps(out + k, r);
+    }
+    noise_batch_scalar(xs + k, ys + k, out + k, n - k);
+}
+
+struct CpuFeatures {
+    bool sse42 = false;
+    bool avx2 = false;
+    bool avx512 = false;
+};
+
+CpuFeatures detectCpu() {
+    CpuFeatures f;
+#if defined(_MSC_VER) && !defined(__clang__)
+    int r[4];
+    __cpuid(r, 0);
+    const int maxLeaf = r[0];
+    __cpuid(r, 1);
+    f.sse42 = (r[2] & (1 << 20)) != 0;
+    const bool osxsave = (r[2] & (1 << 27)) != 0;
+    if (osxsave && maxLeaf >= 7) {
+        const unsigned long long xcr0 = _xgetbv(0);
+        __cpuidex(r, 7, 0);
+        f.avx2 = (xcr0 & 0x6) == 0x6 && (r[1] & (1 << 5)) != 0;
+        f.avx512 = (xcr0 & 0xE6) == 0xE6 && (r[1] & (1 << 16)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    f.sse42 = __builtin_cpu_supports("sse4.2");
+    f.avx2 = __builtin_cpu_supports("avx2");
+    f.avx512 = __builtin_cpu_supports("avx512f");
+#endif
+    return f;
+}
+
+#endif
+
+struct NoiseBatchPath {
+    NoiseBatchFn fn = noise_batch_scalar;
+    const char* name = "scalar";
+
+    NoiseBatchPath() {
+#if FJ_NOISE_SIMD
+        const CpuFeatures cpu = detectCpu();
+        if (cpu.avx512) {
+            fn = noise_batch_avx512;
+            name = "avx512";
+        }
+        else if (cpu.avx2) {
+            fn = noise_batch_avx2;
+            name = "avx2";
+        }
+        else if (cpu.sse42) {
+            fn = noise_batch_sse42;
+            name = "sse4.2";
+        }
+#endif
+    }
+};
+
+const NoiseBatchPath& batchPath() {
+    static const NoiseBatchPath path;
+    return path;
+}
+
+}
+
+void noise_batch(const float* xs, const float* ys, float* out, size_t n) {
+    batchPath().fn(xs, ys, out, n);
+}
+
+const char* noise_batch_isa() {
+    return batchPath().name;
+}
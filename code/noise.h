@@ -1,9 +1,20 @@
 #pragma once
 
-#pragma once
-
 #include <vector>
 #include <cstdint>
+#include <cstddef>
 #include <memory>
 
-float noise(float x, float y);
\ No newline at end of file
+float noise(float x, float y);
+
+/*
+	Batched version of noise(): out[k] = noise(xs[k], ys[k]) for k in [0; n).
+	SIMD path (AVX-512 / AVX2 / SSE4.2) is picked once at runtime from CPU features.
+	Every path repeats the scalar operation order without FMA contraction,
+	so results are bit-identical to noise() for |x|, |y| < 2^31, as long as the scalar
+	function itself is not contracted either (GCC with -march=native needs -ffp-contract=off).
+*/
+void noise_batch(const float* xs, const float* ys, float* out, size_t n);
+
+// Name of the SIMD path used by noise_batch ("avx512", "avx2", "sse4.2" or "scalar")
+const char* noise_batch_isa();
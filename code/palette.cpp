@@ -0,0 +1,38 @@
+#include "palette.h"
+
+Palette::Palette(std::initializer_list<Stop> stops) {
+    for (int k = 0; k <= entries; ++k) {
+        const float elev = (k + 0.5f) / entries;
+        ofColor color = fallback;
+        if (k < entries) {
+            for (const Stop& s : stops) {
+                if (elev >= s.low && elev < s.high) {
+                    color.r = ofMap(elev, s.low, s.high, s.lowColor.r, s.highColor.r, true);
+                    color.g = ofMap(elev, s.low, s.high, s.lowColor.g, s.highColor.g, true);
+                    color.b = ofMap(elev, s.low, s.high, s.lowColor.b, s.highColor.b, true);
+                    break;
+                }
+            }
+        }
+        table[k] = color;
+    }
+}
+
+const Palette& Palette::forMapType(int mapType) {
+    static const Palette summer = {
+        {0.0f, 0.51f, ofColor(0, 0, 255), ofColor(0, 0, 255)},  // Water
+        {0.51f, 0.53f, ofColor(220, 212, 156), ofColor(34, 139, 34)}, // Sand to Grass
+        {0.53f, 0.6f, ofColor(34, 139, 34), ofColor(0, 102, 51)},     // Grass to Forest
+        {0.6f, 0.85f, ofColor(0, 102, 51), ofColor(210, 180, 140)},   // Forest to Earth
+        {0.85f, 0.9f, ofColor(210, 180, 140), ofColor(224, 224, 224)}, // Earth to Grey
+        {0.9f, 1.0f, ofColor(224, 224, 224), ofColor(224, 224, 224)}  // Grey
+    };
+    static const Palette winter = {
+        {0.0f, 0.51f, ofColor(181, 211, 255), ofColor(181, 211, 255)}, // Ice
+        {0.51f, 0.6f, ofColor(0, 102, 51), ofColor(32, 32,32)},       // Grey4 to Grey3
+        {0.6f, 0.75f, ofColor(32, 32, 32), ofColor(224,224, 224)},    // Grey3 to Snow
+        {0.75f, 0.9f, ofColor(224, 224, 224), ofColor(255, 255, 255)}, // Snow
+        {0.9f, 1.0f, ofColor(255, 255, 255), ofColor(255, 255, 255)}   // Snow
+    };
+    return mapType < 0 ? winter : summer;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "ofMain.h"
+#include <array>
+#include <cstdint>
+#include <initializer_list>
+
+/*
+	Elevation -> colour gradient baked into a dense table.
+	Entry k holds the colour at elevation (k + 0.5) / entries; the extra last entry
+	is used for elevations >= 1, which no gradient stop covers.
+	Shading is an 8.8 fixed-point multiply, so a lookup has no map search and no float channel math.
+*/
+class Palette {
+public:
+	static constexpr int entries = 1024;
+
+	// Colour goes from lowColor to highColor over [low; high)
+	struct Stop {
+		float low;
+		float high;
+		ofColor lowColor;
+		ofColor highColor;
+	};
+
+	Palette(std::initializer_list<Stop> stops);
+
+	/*
+		elev is the elevation mapped to [0; 1], intensity is the light factor in [0; 1].
+		Negative or NaN elevations get the unlit fallback colour.
+	*/
+	ofColor shade(float elev, float intensity) const {
+		if (!(elev >= 0.0f)) {
+			return fallback;
+		}
+		const ofColor& c = table[static_cast<int>(std::min(elev * entries, static_cast<float>(entries)))];
+		const uint32_t light = static_cast<uint32_t>(intensity * 256.0f + 0.5f);
+		return ofColor((c.r * light) >> 8, (c.g * light) >> 8, (c.b * light) >> 8);
+	}
+
+	// Palette for RenderEngine's mapType: 1 is summer, -1 is winter
+	static const Palette& forMapType(int mapType);
+
+private:
+	std::array<ofColor, entries + 1> table;
+	ofColor fallback = ofColor(192, 192, 192);
+};
@@ -0,0 +1,89 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+
+Profiler& Profiler::shared() {
+    static Profiler profiler;
+    return profiler;
+}
+
+const char* Profiler::stageName(ProfileStage stage) {
+    static const char* const names[stageCount] = {
+        "frame", "draw", "update", "generate", "remap", "quadtree",
+        "render", "select", "setup", "raster", "raster_tiles", "upload", "gui"
+    };
+    return names[static_cast<size_t>(stage)];
+}
+
+void Profiler::endFrame() {
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    add(ProfileStage::Frame, now - lastFrameEnd);
+    lastFrameEnd = now;
+
+    FrameTimes times;
+    for (size_t s = 0; s < stageCount; ++s) {
+        times[s] = static_cast<float>(totals[s].exchange(0, std::memory_order_relaxed) * 1e-6);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (history.size() < historyFrames) {
+        history.push_back(times);
+    }
+    else {
+        history[frames % historyFrames] = times;
+    }
+    ++frames;
+}
+
+Profiler::Percentiles Profiler::percentiles(ProfileStage stage) const {
+    std::vector<float> window;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const uint64_t count = std::min<uint64_t>(frames, windowFrames);
+        window.reserve(count);
+        for (uint64_t f = frames - count; f < frames; ++f) {
+            window.push_back(history[f % historyFrames][static_cast<size_t>(stage)]);
+        }
+    }
+    Percentiles result;
+    if (window.empty()) {
+        return result;
+    }
+    std::sort(window.begin(), window.end());
+    auto at = [&](double q) { return window[std::min(window.size() - 1, static_cast<size_t>(q * window.size()))]; };
+    result.p50 = at(0.50);
+    result.p95 = at(0.95);
+    result.p99 = at(0.99);
+    return result;
+}
+
+bool Profiler::writeCsv(const std::string& path) const {
+    const std::filesystem::path target(path);
+    if (target.has_parent_path()) {
+        std::error_code error;
+        std::filesystem::create_directories(target.parent_path(), error);
+    }
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        return false;
+    }
+    fprintf(file, "frame");
+    for (size_t s = 0; s < stageCount; ++s) {
+        fprintf(file, ",%s_ms", stageName(static_cast<ProfileStage>(s)));
+    }
+    fprintf(file, "\n");
+
+    std::lock_guard<std::mutex> lock(mutex);
+    const uint64_t first = frames - std::min<uint64_t>(frames, historyFrames);
+    for (uint64_t f = first; f < frames; ++f) {
+        const FrameTimes& times = history[f % historyFrames];
+        fprintf(file, "%llu", static_cast<unsigned long long>(f));
+        for (float ms : times) {
+            fprintf(file, ",%.4f", ms);
+        }
+        fprintf(file, "\n");
+    }
+    return fclose(file) == 0;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class ProfileStage {
+	Frame,       // wall time between endFrame() calls, vsync included
+	Draw,        // ofApp::draw without the overlay
+	Update,      // Fjord::update
+	Generate,    // generator tiles, streaming included
+	Remap,       // Fjord::applyMapType
+	Quadtree,    // TerrainQuadtree::build
+	Render,      // RenderEngine::render
+	Select,      // LOD chunk selection
+	Setup,       // vertex transform and shading
+	Raster,      // binning + rasterization, wall time
+	RasterTiles, // per-tile rasterization, summed over workers
+	Upload,      // framebuffer to texture
+	Gui,         // ofxPanel
+	Count
+};
+
+/*
+	Per-stage frame profiler.
+	Timings add up into the current frame's stage totals from any thread, lock-free;
+	a stage timed inside parallel jobs therefore reports CPU time summed over workers.
+	endFrame() closes the frame into a history ring: the last windowFrames frames feed
+	the percentiles, the whole ring is what writeCsv() dumps.
+*/
+class Profiler {
+public:
+	static constexpr size_t stageCount = static_cast<size_t>(ProfileStage::Count);
+	// ~4 s at 60 fps
+	static constexpr size_t windowFrames = 240;
+	// ~10 min at 60 fps
+	static constexpr size_t historyFrames = 36000;
+
+	// Milliseconds
+	struct Percentiles {
+		double p50 = 0;
+		double p95 = 0;
+		double p99 = 0;
+	};
+
+	static Profiler& shared();
+	static const char* stageName(ProfileStage stage);
+
+	void add(ProfileStage stage, std::chrono::steady_clock::duration elapsed) {
+		totals[static_cast<size_t>(stage)].fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(), std::memory_order_relaxed);
+	}
+	void addSeconds(ProfileStage stage, double seconds) {
+		totals[static_cast<size_t>(stage)].fetch_add(static_cast<int64_t>(seconds * 1e9), std::memory_order_relaxed);
+	}
+
+	void endFrame();
+	Percentiles percentiles(ProfileStage stage) const;
+	// One row per recorded frame, one millisecond column per stage
+	bool writeCsv(const std::string& path) const;
+
+private:
+	using FrameTimes = std::array<float, stageCount>;
+
+	std::array<std::atomic<int64_t>, stageCount> totals{};
+	std::chrono::steady_clock::time_point lastFrameEnd = std::chrono::steady_clock::now();
+
+	mutable std::mutex mutex;
+	std::vector<FrameTimes> history;
+	// Frames closed so far; frame f lives at history[f % historyFrames]
+	uint64_t frames = 0;
+};
+
+/*
+	Adds its lifetime to 'stage' of the current frame.
+*/
+class ProfileScope {
+private:
+	ProfileStage stage;
+	std::chrono::steady_clock::time_point start;
+
+public:
+	explicit ProfileScope(ProfileStage stage) : stage{ stage }, start{ std::chrono::steady_clock::now() } {}
+	~ProfileScope() { Profiler::shared().add(stage, std::chrono::steady_clock::now() - start); }
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+};
@@ -0,0 +1,486 @@
+#include "raster.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define FJ_RASTER_SSE 1
+#include <emmintrin.h>
+#else
+#define FJ_RASTER_SSE 0
+#endif
+
+void TileRasterizer::begin(const FrameBuffer& frame) {
+    width = frame.getWidth();
+    height = frame.getHeight();
+    tilesX = (width + tileSize - 1) / tileSize;
+    tilesY = (height + tileSize - 1) / tileSize;
+    depth.assign(static_cast<size_t>(tilesX) * tilesY * tileSize * tileSize, FLT_MAX);
+    blocksX = tilesX * blocksPerTile;
+    blocksY = tilesY * blocksPerTile;
+    blockFar.assign(static_cast<size_t>(blocksX) * blocksY, FLT_MAX);
+}
+
+bool TileRasterizer::occluded(float minX, float minY, float maxX, float maxY, float nearZ) const {
+    // One pixel of slack covers snapping; whatever lies off screen can't be hidden
+    const int bx0 = static_cast<int>(std::max(0.0f, minX - 1.0f)) / blockSize;
+    const int by0 = static_cast<int>(std::max(0.0f, minY - 1.0f)) / blockSize;
+    const int bx1 = static_cast<int>(std::min(static_cast<float>(width - 1), maxX + 1.0f)) / blockSize;
+    const int by1 = static_cast<int>(std::min(static_cast<float>(height - 1), maxY + 1.0f)) / blockSize;
+    if (!(minX <= maxX && minY <= maxY) || bx0 > bx1 || by0 > by1) {
+        return false;
+    }
+    for (int by = by0; by <= by1; ++by) {
+        const float* row = blockFar.data() + static_cast<size_t>(by) * blocksX;
+        for (int bx = bx0; bx <= bx1; ++bx) {
+            if (row[bx] > nearZ) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+namespace {
+
+constexpr int blockSize = TileRasterizer::blockSize;
+// Edge values must fit in 32 bits across a tile: see subpixelBitsFor()
+constexpr int64_t edgeClamp = int64_t(1) << 30;
+constexpr int64_t fixedRange = int64_t(1) << 21;
+
+// Division by 2^bits rounding down; relies on >> being arithmetic for negative values, as on every supported compiler
+int64_t floorShift(int64_t a, int bits) {
+    return a >> bits;
+}
+
+int64_t ceilShift(int64_t a, int bits) {
+    return -(-a >> bits);
+}
+
+// Round to nearest, ties to even like std::nearbyint, without the library call
+int32_t roundToInt(float v) {
+#if FJ_RASTER_SSE
+    return _mm_cvtss_si32(_mm_set_ss(v));
+#else
+    return static_cast<int32_t>(std::nearbyint(v));
+#endif
+}
+
+/*
+    Sub-pixel precision for a triangle: 8 bits unless a vertex is so far off screen that
+    tile-relative fixed-point coordinates would leave [-2^21; 2^21]. Then edge deltas stay
+    below 2^22 and an edge varies by less than 2^29 over a tile, so clamped edge values
+    never overflow. Chosen per triangle, not per tile, so every tile snaps it the same way.
+    Returns -1 for triangles beyond even whole-pixel range.
+*/
+int subpixelBitsFor(const ScreenTriangle& t, int width, int height) {
+    const float reach = std::max({ std::abs(t.x[0]), std::abs(t.x[1]), std::abs(t.x[2]),
+        std::abs(t.y[0]), std::abs(t.y[1]), std::abs(t.y[2]) }) + std::max(width, height);
+    for (int bits = TileRasterizer::subpixelBits; bits >= 0; --bits) {
+        if (reach * (1 << bits) < fixedRange) {
+            return bits;
+        }
+    }
+    return -1;
+}
+
+/*
+    A triangle set up against one tile. Pixels are addressed from the tile origin.
+    Edge k is inside where a[k] * px + b[k] * py + c[k] >= 0, the top-left rule already
+    folded into c. Lane 3 is a dummy edge that is always inside, so the three edges fill
+    one SSE register. The block and lane tables are only filled by prepareBlocks().
+*/
+struct TriangleSetup {
+    alignas(16) int32_t a[4];
+    alignas(16) int32_t b[4];
+    alignas(16) int32_t c[4];
+    // Added to an edge's value at a block origin to get its maximum / minimum over the block
+    alignas(16) int32_t blockMax[4];
+    alignas(16) int32_t blockMin[4];
+    // a[k] * lane, for the 8 pixels of a block row
+    alignas(16) int32_t laneStep[3][blockSize];
+    alignas(16) float laneDepth[blockSize];
+
+    // Depth plane: z = zOrigin + dzdx * px + dzdy * py
+    float zOrigin;
+    float dzdx;
+    float dzdy;
+
+    // Covered pixel bounds, inclusive, clipped to the tile and the screen
+    int x0, y0, x1, y1;
+};
+
+bool setupTriangle(const ScreenTriangle& t, int originX, int originY, int limitX, int limitY, int bits, TriangleSetup& s) {
+    const float unit = static_cast<float>(1 << bits);
+    int64_t fx[3], fy[3];
+    for (int k = 0; k < 3; ++k) {
+        fx[k] = roundToInt(t.x[k] * unit) - (int64_t(originX) << bits);
+        fy[k] = roundToInt(t.y[k] * unit) - (int64_t(originY) << bits);
+    }
+
+    const int64_t signedArea = (fx[1] - fx[0]) * (fy[2] - fy[0]) - (fy[1] - fy[0]) * (fx[2] - fx[0]);
+    if (signedArea == 0) {
+        return false;
+    }
+    // Edges are set up for positive area; front faces arrive negative (clockwise on screen)
+    int order[3] = { 0, 1, 2 };
+    if (signedArea < 0) {
+        std::swap(order[1], order[2]);
+    }
+
+    const int64_t minX = std::min({ fx[0], fx[1], fx[2] });
+    const int64_t maxX = std::max({ fx[0], fx[1], fx[2] });
+    const int64_t minY = std::min({ fy[0], fy[1], fy[2] });
+    const int64_t maxY = std::max({ fy[0], fy[1], fy[2] });
+    s.x0 = static_cast<int>(std::max<int64_t>(ceilShift(minX, bits), 0));
+    s.x1 = static_cast<int>(std::min<int64_t>(floorShift(maxX, bits), limitX));
+    s.y0 = static_cast<int>(std::max<int64_t>(ceilShift(minY, bits), 0));
+    s.y1 = static_cast<int>(std::min<int64_t>(floorShift(maxY, bits), limitY));
+    if (s.x0 > s.x1 || s.y0 > s.y1) {
+        return false;
+    }
+
+    for (int k = 0; k < 3; ++k) {
+        const int from = order[k];
+        const int to = order[(k + 1) % 3];
+        const int64_t a = fy[from] - fy[to];
+        const int64_t b = fx[to] - fx[from];
+        /*
+            At pixel (px, py) the fixed-point edge function is 2^bits * (a * px + b * py) + c.
+            Top and left edges own the pixels exactly on them, the others need c >= 1:
+            that way a pixel on an edge shared by two triangles is drawn exactly once.
+            Pixels sit on whole units, so c can then be shifted down by 'bits' exactly.
+        */
+        const bool topLeft = a > 0 || (a == 0 && b > 0);
+        const int64_t c = -a * fx[from] - b * fy[from] - (topLeft ? 0 : 1);
+        s.a[k] = static_cast<int32_t>(a);
+        s.b[k] = static_cast<int32_t>(b);
+        s.c[k] = static_cast<int32_t>(std::clamp(floorShift(c, bits), -edgeClamp, edgeClamp));
+    }
+    s.a[3] = s.b[3] = s.c[3] = 0;
+
+    /*
+        Depth plane through the snapped vertices. In fixed point the gradient is
+        (dz1 * dy2 - dz2 * dy1) / signedArea per 2^-bits pixel, so scale it up to whole pixels.
+    */
+    const float dz1 = t.z[1] - t.z[0];
+    const float dz2 = t.z[2] - t.z[0];
+    const float perPixel = static_cast<float>(1 << bits) / static_cast<float>(signedArea);
+    s.dzdx = (dz1 * static_cast<float>(fy[2] - fy[0]) - dz2 * static_cast<float>(fy[1] - fy[0])) * perPixel;
+    s.dzdy = (dz2 * static_cast<float>(fx[1] - fx[0]) - dz1 * static_cast<float>(fx[2] - fx[0])) * perPixel;
+    const float toPixels = 1.0f / (1 << bits);
+    s.zOrigin = t.z[0] - s.dzdx * (fx[0] * toPixels) - s.dzdy * (fy[0] * toPixels);
+    return true;
+}
+
+void prepareBlocks(TriangleSetup& s) {
+    for (int k = 0; k < 3; ++k) {
+        s.blockMax[k] = (std::max(0, s.a[k]) + std::max(0, s.b[k])) * (blockSize - 1);
+        s.blockMin[k] = (std::min(0, s.a[k]) + std::min(0, s.b[k])) * (blockSize - 1);
+        for (int lane = 0; lane < blockSize; ++lane) {
+            s.laneStep[k][lane] = s.a[k] * lane;
+        }
+    }
+    s.blockMax[3] = s.blockMin[3] = 0;
+    for (int lane = 0; lane < blockSize; ++lane) {
+        s.laneDepth[lane] = s.dzdx * lane;
+    }
+}
+
+enum class BlockCoverage { None, Partial, Full };
+
+// Trivial reject / accept from the block corners that maximize / minimize each edge
+BlockCoverage classifyBlock(const TriangleSetup& s, const int32_t edges[4]) {
+#if FJ_RASTER_SSE
+    const __m128i e = _mm_load_si128(reinterpret_cast<const __m128i*>(edges));
+    const __m128i highest = _mm_add_epi32(e, _mm_load_si128(reinterpret_cast<const __m128i*>(s.blockMax)));
+    if (_mm_movemask_ps(_mm_castsi128_ps(highest)) != 0) {
+        return BlockCoverage::None;
+    }
+    const __m128i lowest = _mm_add_epi32(e, _mm_load_si128(reinterpret_cast<const __m128i*>(s.blockMin)));
+    return _mm_movemask_ps(_mm_castsi128_ps(lowest)) == 0 ? BlockCoverage::Full : BlockCoverage::Partial;
+#else
+    bool full = true;
+    for (int k = 0; k < 3; ++k) {
+        if (edges[k] + s.blockMax[k] < 0) {
+            return BlockCoverage::None;
+        }
+        full = full && edges[k] + s.blockMin[k] >= 0;
+    }
+    return full ? BlockCoverage::Full : BlockCoverage::Partial;
+#endif
+}
+
+// Bit i set when pixel i of a block row is inside all three edges
+unsigned rowCoverage(const TriangleSetup& s, const int32_t edges[4]) {
+#if FJ_RASTER_SSE
+    __m128i low = _mm_setzero_si128();
+    __m128i high = _mm_setzero_si128();
+    for (int k = 0; k < 3; ++k) {
+        const __m128i e = _mm_set1_epi32(edges[k]);
+        low = _mm_or_si128(low, _mm_add_epi32(e, _mm_load_si128(reinterpret_cast<const __m128i*>(s.laneStep[k]))));
+        high = _mm_or_si128(high, _mm_add_epi32(e, _mm_load_si128(reinterpret_cast<const __m128i*>(s.laneStep[k] + 4))));
+    }
+    const unsigned outside = _mm_movemask_ps(_mm_castsi128_ps(low)) | (_mm_movemask_ps(_mm_castsi128_ps(high)) << 4);
+    return ~outside & 0xFFu;
+#else
+    unsigned mask = 0;
+    for (int lane = 0; lane < blockSize; ++lane) {
+        const int32_t signs = (edges[0] + s.laneStep[0][lane]) | (edges[1] + s.laneStep[1][lane]) | (edges[2] + s.laneStep[2][lane]);
+        mask |= (signs >= 0 ? 1u : 0u) << lane;
+    }
+    return mask;
+#endif
+}
+
+/*
+    Depth-tests the pixels of 'mask' in one block row and writes the ones that pass.
+    'z' is the depth at the row's first pixel.
+*/
+void shadeRow(const TriangleSetup& s, unsigned mask, float z, float* depthRow, unsigned char* colorRow, const ofColor& color) {
+    alignas(16) float zs[blockSize];
+#if FJ_RASTER_SSE
+    const __m128 base = _mm_set1_ps(z);
+    const __m128 zLow = _mm_add_ps(base, _mm_load_ps(s.laneDepth));
+    const __m128 zHigh = _mm_add_ps(base, _mm_load_ps(s.laneDepth + 4));
+    _mm_store_ps(zs, zLow);
+    _mm_store_ps(zs + 4, zHigh);
+    mask &= _mm_movemask_ps(_mm_cmplt_ps(zLow, _mm_loadu_ps(depthRow)))
+        | (_mm_movemask_ps(_mm_cmplt_ps(zHigh, _mm_loadu_ps(depthRow + 4))) << 4);
+#else
+    for (int lane = 0; lane < blockSize; ++lane) {
+        zs[lane] = z + s.laneDepth[lane];
+        if (!(zs[lane] < depthRow[lane])) {
+            mask &= ~(1u << lane);
+        }
+    }
+#endif
+    for (int lane = 0; mask != 0; ++lane, mask >>= 1) {
+        if (mask & 1) {
+            depthRow[lane] = zs[lane];
+            unsigned char* p = colorRow + lane * 4;
+            p[0] = color.r;
+            p[1] = color.g;
+            p[2] = color.b;
+            p[3] = 255;
+        }
+    }
+}
+
+}
+
+bool TileRasterizer::tileBounds(const ScreenTriangle& t, int& tx0, int& ty0, int& tx1, int& ty1) const {
+    if (!std::isfinite(t.x[0] + t.x[1] + t.x[2] + t.y[0] + t.y[1] + t.y[2])) {
+        return false;
+    }
+    // Half a pixel of slack: the rasterizer covers snapped vertices, which may round outwards
+    const float minX = std::max(0.0f, std::min({ t.x[0], t.x[1], t.x[2] }) - 0.5f);
+    const float maxX = std::min(static_cast<float>(width - 1), std::max({ t.x[0], t.x[1], t.x[2] }) + 0.5f);
+    const float minY = std::max(0.0f, std::min({ t.y[0], t.y[1], t.y[2] }) - 0.5f);
+    const float maxY = std::min(static_cast<float>(height - 1), std::max({ t.y[0], t.y[1], t.y[2] }) + 0.5f);
+    if (maxX < minX || maxY < minY) {
+        return false;
+    }
+    tx0 = static_cast<int>(minX) / tileSize;
+    tx1 = static_cast<int>(maxX) / tileSize;
+    ty0 = static_cast<int>(minY) / tileSize;
+    ty1 = static_cast<int>(maxY) / tileSize;
+    return true;
+}
+
+void TileRasterizer::draw(const TriangleBatch* batches, size_t count, FrameBuffer& frame, WorkerPool& pool) {
+    const size_t tiles = static_cast<size_t>(tilesX) * tilesY;
+    if (tiles == 0) {
+        return;
+    }
+
+    /*
+        Binning: count references per (batch, tile), turn counts into write cursors
+        ordered tile-major then batch, and fill. Each batch writes only its own slots.
+    */
+    binCounts.assign(count * tiles, 0);
+    pool.parallelFor(count, [&](size_t b) {
+        uint32_t* counts = &binCounts[b * tiles];
+        int tx0, ty0, tx1, ty1;
+        for (const ScreenTriangle& t : batches[b]) {
+            if (!tileBounds(t, tx0, ty0, tx1, ty1)) {
+                continue;
+            }
+            for (int ty = ty0; ty <= ty1; ++ty) {
+                for (int tx = tx0; tx <= tx1; ++tx) {
+                    ++counts[ty * tilesX + tx];
+                }
+            }
+        }
+    });
+
+    tileStart.resize(tiles + 1);
+    uint32_t total = 0;
+    for (size_t tile = 0; tile < tiles; ++tile) {
+        tileStart[tile] = total;
+        for (size_t b = 0; b < count; ++b) {
+            const uint32_t count = binCounts[b * tiles + tile];
+            binCounts[b * tiles + tile] = total;
+            total += count;
+        }
+    }
+    tileStart[tiles] = total;
+    binned.resize(total);
+
+    pool.parallelFor(count, [&](size_t b) {
+        uint32_t* cursor = &binCounts[b * tiles];
+        int tx0, ty0, tx1, ty1;
+        for (const ScreenTriangle& t : batches[b]) {
+            if (!tileBounds(t, tx0, ty0, tx1, ty1)) {
+                continue;
+            }
+            for (int ty = ty0; ty <= ty1; ++ty) {
+                for (int tx = tx0; tx <= tx1; ++tx) {
+                    binned[cursor[ty * tilesX + tx]++] = &t;
+                }
+            }
+        }
+    });
+
+    pool.parallelFor(tiles, [&](size_t tile) {
+        rasterizeTile(static_cast<int>(tile), frame);
+    });
+}
+
+void TileRasterizer::rasterizeTile(int tile, FrameBuffer& frame) {
+    ProfileScope profile(ProfileStage::RasterTiles);
+    uint64_t touched = 0;
+    for (uint32_t k = tileStart[tile]; k < tileStart[tile + 1]; ++k) {
+        touched |= rasterizeTriangle(*binned[k], tile, frame);
+    }
+
+    // Refresh the far depth of every block the tile's triangles may have written
+    const int originX = (tile % tilesX) * tileSize;
+    const int originY = (tile / tilesX) * tileSize;
+    const float* tileDepth = depth.data() + static_cast<size_t>(tile) * tileSize * tileSize;
+    for (int b = 0; touched != 0; ++b, touched >>= 1) {
+        if (!(touched & 1)) {
+            continue;
+        }
+        const int bx = b % blocksPerTile;
+        const int by = b / blocksPerTile;
+        const float* blockDepth = tileDepth + by * blockSize * tileSize + bx * blockSize;
+        float farthest = 0;
+        for (int y = 0; y < blockSize; ++y) {
+            farthest = std::max(farthest, *std::max_element(blockDepth + y * tileSize, blockDepth + y * tileSize + blockSize));
+        }
+        blockFar[static_cast<size_t>(originY / blockSize + by) * blocksX + originX / blockSize + bx] = farthest;
+    }
+}
+
+uint64_t TileRasterizer::rasterizeTriangle(const ScreenTriangle& t, int tile, FrameBuffer& frame) {
+    const int originX = (tile % tilesX) * tileSize;
+    const int originY = (tile / tilesX) * tileSize;
+    const int bits = subpixelBitsFor(t, width, height);
+    if (bits < 0) {
+        return 0;
+    }
+    TriangleSetup s;
+    const int limitX = std::min(tileSize, width - originX) - 1;
+    const int limitY = std::min(tileSize, height - originY) - 1;
+    if (!setupTriangle(t, originX, originY, limitX, limitY, bits, s)) {
+        return 0;
+    }
+
+    // Blocks under the bounding box, bit by * blocksPerTile + bx
+    uint64_t touched = 0;
+    const uint64_t columnBits = (uint64_t(0xFF) >> (blocksPerTile - 1 - s.x1 / blockSize)) & (uint64_t(0xFF) << (s.x0 / blockSize));
+    for (int by = s.y0 / blockSize; by <= s.y1 / blockSize; ++by) {
+        touched |= columnBits << (by * blocksPerTile);
+    }
+
+    float* tileDepth = depth.data() + static_cast<size_t>(tile) * tileSize * tileSize;
+
+    /*
+        Most terrain triangles are a few pixels across: for those the block tables cost
+        more than they save, so step the edges pixel by pixel over the bounding box.
+    */
+    if (s.x1 - s.x0 < blockSize && s.y1 - s.y0 < blockSize) {
+        int32_t rowEdges[3];
+        for (int k = 0; k < 3; ++k) {
+            rowEdges[k] = s.c[k] + s.a[k] * s.x0 + s.b[k] * s.y0;
+        }
+        float rowZ = s.zOrigin + s.dzdx * s.x0 + s.dzdy * s.y0;
+        for (int y = s.y0; y <= s.y1; ++y) {
+            float* depthRow = tileDepth + y * tileSize;
+            unsigned char* colorRow = frame.colorRow(originY + y) + originX * 4;
+            int32_t e0 = rowEdges[0], e1 = rowEdges[1], e2 = rowEdges[2];
+            float z = rowZ;
+            for (int x = s.x0; x <= s.x1; ++x) {
+                if ((e0 | e1 | e2) >= 0 && z < depthRow[x]) {
+                    depthRow[x] = z;
+                    unsigned char* p = colorRow + x * 4;
+                    p[0] = t.color.r;
+                    p[1] = t.color.g;
+                    p[2] = t.color.b;
+                    p[3] = 255;
+                }
+                e0 += s.a[0];
+                e1 += s.a[1];
+                e2 += s.a[2];
+                z += s.dzdx;
+            }
+            for (int k = 0; k < 3; ++k) {
+                rowEdges[k] += s.b[k];
+            }
+            rowZ += s.dzdy;
+        }
+        return touched;
+    }
+    prepareBlocks(s);
+
+    /*
+        Walk the 8x8 blocks of the bounding box. Edge values start at the first block's
+        origin and only ever get added to from there; blocks wholly outside an edge are
+        skipped, blocks wholly inside all three skip the per-pixel edge test.
+    */
+    const int bx0 = s.x0 & ~(blockSize - 1);
+    const int by0 = s.y0 & ~(blockSize - 1);
+    alignas(16) int32_t blockRow[4];
+    for (int k = 0; k < 4; ++k) {
+        blockRow[k] = s.c[k] + s.a[k] * bx0 + s.b[k] * by0;
+    }
+    for (int by = by0; by <= s.y1; by += blockSize) {
+        const int rowFirst = std::max(by, s.y0);
+        const int rowLast = std::min(by + blockSize - 1, s.y1);
+        alignas(16) int32_t block[4] = { blockRow[0], blockRow[1], blockRow[2], blockRow[3] };
+        for (int bx = bx0; bx <= s.x1; bx += blockSize) {
+            const BlockCoverage coverage = classifyBlock(s, block);
+            if (coverage != BlockCoverage::None) {
+                // Columns of the block inside the clipped bounding box
+                const int first = std::max(s.x0 - bx, 0);
+                const int last = std::min(s.x1 - bx, blockSize - 1);
+                const unsigned columns = (0xFFu >> (blockSize - 1 - last)) & (0xFFu << first);
+
+                alignas(16) int32_t edges[4];
+                for (int k = 0; k < 4; ++k) {
+                    edges[k] = block[k] + s.b[k] * (rowFirst - by);
+                }
+                float z = s.zOrigin + s.dzdx * bx + s.dzdy * rowFirst;
+                for (int y = rowFirst; y <= rowLast; ++y) {
+                    const unsigned mask = coverage == BlockCoverage::Full ? columns : rowCoverage(s, edges) & columns;
+                    if (mask != 0) {
+                        shadeRow(s, mask, z, tileDepth + y * tileSize + bx, frame.colorRow(originY + y) + (originX + bx) * 4, t.color);
+                    }
+                    for (int k = 0; k < 3; ++k) {
+                        edges[k] += s.b[k];
+                    }
+                    z += s.dzdy;
+                }
+            }
+            for (int k = 0; k < 4; ++k) {
+                block[k] += s.a[k] * blockSize;
+            }
+        }
+        for (int k = 0; k < 4; ++k) {
+            blockRow[k] += s.b[k] * blockSize;
+        }
+    }
+    return touched;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "framebuffer.h"
+#include "workers.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/*
+	Projected, flat-shaded triangle ready for rasterization.
+	x, y in pixels, z is the depth compared in the z-buffer.
+*/
+struct ScreenTriangle {
+	float x[3];
+	float y[3];
+	float z[3];
+	ofColor color;
+};
+
+/*
+	Cheap pre-binning test: false when the triangle's bounds contain no pixel sample of a
+	width x height target (off-screen, or small enough to fall between samples).
+	Bounds are widened by the rasterizer's snapping error, half of 1/256 pixel, so a
+	triangle whose snapped vertices reach a sample is never dropped here.
+*/
+inline bool coversSamples(const ScreenTriangle& t, int width, int height) {
+	constexpr float snap = 0.5f / 256.0f;
+	const float minX = std::max(0.0f, std::ceil(std::min({ t.x[0], t.x[1], t.x[2] }) - snap));
+	const float maxX = std::min(static_cast<float>(width - 1), std::floor(std::max({ t.x[0], t.x[1], t.x[2] }) + snap));
+	const float minY = std::max(0.0f, std::ceil(std::min({ t.y[0], t.y[1], t.y[2] }) - snap));
+	const float maxY = std::min(static_cast<float>(height - 1), std::floor(std::max({ t.y[0], t.y[1], t.y[2] }) + snap));
+	return minX <= maxX && minY <= maxY;
+}
+
+// Triangles emitted by one setup job, kept in submission order
+using TriangleBatch = std::vector<ScreenTriangle>;
+
+/*
+	Two-phase sort-middle rasterizer.
+		1. Binning: every triangle is referenced from each 64x64 screen tile its bounds touch.
+		2. Rasterization: one job per tile, owning that tile's depth buffer and framebuffer pixels.
+	Jobs never share pixels, so there are no locks and no nested parallel regions.
+	Within a tile triangles are drawn in submission order, so output doesn't depend on thread count.
+
+	Triangles are scan-converted with integer edge functions on vertices snapped to
+	1/256 pixel, under the top-left fill rule: a pixel on an edge shared by two triangles
+	belongs to exactly one of them. Each tile is walked in 8x8 blocks that are rejected or
+	accepted whole against the three edges before any per-pixel work.
+*/
+class TileRasterizer {
+public:
+	static constexpr int tileSize = 64;
+	static constexpr int subpixelBits = 8;
+	// Side of the pixel blocks walked by the rasterizer and kept in the coarse depth buffer
+	static constexpr int blockSize = 8;
+	static constexpr int blocksPerTile = tileSize / blockSize;
+
+	// Starts a frame: sizes the tile grid to 'frame' and clears depth
+	void begin(const FrameBuffer& frame);
+	// Bins and rasterizes the first 'count' batches into 'frame'; may be called several times per frame
+	void draw(const TriangleBatch* batches, size_t count, FrameBuffer& frame, WorkerPool& pool);
+	/*
+		True when nothing at depth nearZ or further inside the screen rectangle
+		(minX, minY) - (maxX, maxY) can pass the depth test, judging by what earlier
+		draw() calls left in the coarse depth buffer. Conservative, and safe to call
+		from several threads while no draw() is running.
+	*/
+	bool occluded(float minX, float minY, float maxX, float maxY, float nearZ) const;
+
+private:
+	int width = 0;
+	int height = 0;
+	int tilesX = 0;
+	int tilesY = 0;
+
+	// Tile-major depth: tile t owns [t * tileSize^2; (t + 1) * tileSize^2)
+	std::vector<float> depth;
+	/*
+		Coarse depth: the farthest depth in each blockSize^2 pixel block, row-major over
+		blocksX x blocksY. A tile job refreshes its own blocks once it's done.
+	*/
+	std::vector<float> blockFar;
+	int blocksX = 0;
+	int blocksY = 0;
+
+	// binCounts[batch * tiles + tile] during counting, then write cursors
+	std::vector<uint32_t> binCounts;
+	// tileStart[tile] .. tileStart[tile + 1] is the tile's slice of 'binned'
+	std::vector<uint32_t> tileStart;
+	std::vector<const ScreenTriangle*> binned;
+
+	bool tileBounds(const ScreenTriangle& t, int& tx0, int& ty0, int& tx1, int& ty1) const;
+	void rasterizeTile(int tile, FrameBuffer& frame);
+	// Returns the tile's blocks the triangle may have written, bit by * blocksPerTile + bx
+	uint64_t rasterizeTriangle(const ScreenTriangle& t, int tile, FrameBuffer& frame);
+};
@@ -1,7 +1,14 @@
 #include "render.h"
+#include "profiler.h"
+#include "allocations.h"
 
-RenderEngine::RenderEngine(std::unique_ptr<HeightGenerator_Creator> generator_creator, std::function<float(float, float)> noise)
-    : fjord{ std::make_unique<Fjord>(generator_creator->create(std::move(noise))) },
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+
+RenderEngine::RenderEngine(std::unique_ptr<HeightGenerator_Creator> generator_creator)
+    : fjord{ std::make_unique<Fjord>(generator_creator->create(), generator_creator->create()) },
+    builder{ generator_creator->create() },
     modelMatrix(glm::mat4(1.0f)),
     translation(glm::vec3(0.0f)),
     rotationAngle(0.0f),
@@ -12,6 +19,7 @@ RenderEngine::RenderEngine(std::unique_ptr<HeightGenerator_Creator> generator_cr
 void RenderEngine::update(
     bool _regen, int octave, int seed,
     int maxElevation, int tileSize, bool isLake, float waterPercentage) {
+    builder.cancel();
     fjord->update(
         _regen,
         octave,
@@ -21,168 +29,534 @@ void RenderEngine::update(
         isLake,
         waterPercentage
     );
+    dirty = true;
+}
+
+void RenderEngine::requestUpdate(
+    bool _regen, int octave, int seed,
+    int maxElevation, int tileSize, bool isLake, float waterPercentage) {
+    noteInput();
+    // Both only remap or copy data that's already here
+    if (fjord->isStreaming() || fjord->hasNoise(octave, seed, tileSize)) {
+        update(_regen, octave, seed, maxElevation, tileSize, isLake, waterPercentage);
+        return;
+    }
+    FjordBuilder::Settings settings;
+    settings.octave = octave;
+    settings.seed = seed;
+    settings.maxElevation = maxElevation;
+    settings.tileSize = tileSize;
+    settings.isLake = isLake;
+    settings.waterPercentage = waterPercentage;
+    settings.quantized = fjord->isQuantized();
+    builder.request(settings);
+}
+
+bool RenderEngine::isUpdating() const {
+    return builder.isBusy();
+}
+
+void RenderEngine::invalidate() {
+    dirty = true;
+}
+
+void RenderEngine::setProgressive(bool progressive) {
+    this->progressive = progressive;
+    if (!progressive && minLevel > 0) {
+        minLevel = 0;
+        dirty = true;
+    }
+}
+
+void RenderEngine::noteInput() {
+    if (progressive) {
+        minLevel = progressiveLevels;
+        lastInput = std::chrono::steady_clock::now();
+    }
+}
+
+bool RenderEngine::refineProgressive() {
+    if (minLevel == 0 || std::chrono::steady_clock::now() - lastInput < std::chrono::duration<double>(settleSeconds)) {
+        return false;
+    }
+    --minLevel;
+    return true;
+}
+
+void RenderEngine::setStreaming(bool streaming) {
+    fjord->setStreaming(streaming);
+}
+
+void RenderEngine::setQuantized(bool quantized) {
+    fjord->setQuantized(quantized);
+}
+
+void RenderEngine::setCacheDirectory(const std::string& directory) {
+    fjord->setCacheDirectory(directory);
+    builder.setCacheDirectory(directory);
+}
+
+bool RenderEngine::exportTerrain(const std::string& path) const {
+    return fjord->exportTerrain(path);
+}
+
+void RenderEngine::pan(int dx, int dy) {
+    fjord->pan(dx * panStep, dy * panStep);
+    noteInput();
+    dirty = true;
 }
 
 void RenderEngine::render() {
-    glm::mat4 mvp = setupProjection();
-    std::vector<std::vector<float>> zBuffer(ofGetWidth(), std::vector<float>(ofGetHeight(), FLT_MAX));
+    ProfileScope profile(ProfileStage::Render);
+    // All three run every frame: an arrival mustn't hold back a finished build or the refinement
+    const bool streamed = fjord->refreshStream();
+    const bool built = builder.takeResult(*fjord);
+    const bool refined = refineProgressive();
+    if (streamed || built || refined) {
+        dirty = true;
+    }
+    const int width = ofGetWidth();
+    const int height = ofGetHeight();
+    if (dirty || !frameTexture.isAllocated() || width != frame.getWidth() || height != frame.getHeight()) {
+        renderFrame(width, height);
+
+        if (!frameTexture.isAllocated()
+            || frameTexture.getWidth() != frame.getWidth()
+            || frameTexture.getHeight() != frame.getHeight()) {
+            frameTexture.allocate(frame.getWidth(), frame.getHeight(), GL_RGBA8);
+        }
+        ProfileScope upload(ProfileStage::Upload);
+        frameTexture.loadData(frame.getPixels());
+        dirty = false;
+    }
+    ofSetColor(255);
+    frameTexture.draw(0, 0);
+}
+
+bool RenderEngine::saveFrame(const std::string& path, int width, int height) {
+    return ofSaveImage(renderFrame(width, height), path);
+}
+
+const ofPixels& RenderEngine::renderFrame(int width, int height) {
+    frame.resize(width, height);
+    frame.clear(background);
+    rasterizer.begin(frame);
 
-    const float screenWidth = ofGetWidth();
-    const float screenHeight = ofGetHeight();
+    ViewParams view;
+    view.mvp = setupProjection(width, height);
+    extractFrustum(view);
+    view.eye = glm::vec3(glm::inverse(modelView)[3]);
+    view.screenWidth = width;
+    view.screenHeight = height;
+    view.tileSize = fjord->getTileSize();
+    view.maxElevation = fjord->getMaxElevation();
 
     /*
-        Handle each square unit as two simplexes.
+        Pick the chunks to draw for this view, then handle each quad of their meshes as two simplexes.
         For each simplex calculate:
             - Elevation
             - Normal
             - Coordinates on a screen using MVP matrix
+        Chunks are set up in parallel, then binned and rasterized per screen tile.
+        Passes go front to back, so ridges are drawn before the valleys they hide and
+        later passes can drop hidden chunks and triangles before shading them.
+        A pass covers at most chunksPerPass chunks (~1M triangles) so memory stays bounded.
     */
-    int size = fjord->getSize();
-    int tileSize = fjord->getTileSize();
-    int maxElevation = fjord->getMaxElevation();
-    std::vector<std::vector<float>> hmap = fjord->getHeightMap();
-
+    using Clock = std::chrono::steady_clock;
+    auto seconds = [](Clock::time_point from, Clock::time_point to) { return std::chrono::duration<double>(to - from).count(); };
+    stats = FrameStats();
+    stats.minLevel = minLevel;
+    const uint64_t allocationsBefore = allocationCount();
+    arena.reset();
+
+    Clock::time_point start = Clock::now();
+    selectChunks(view);
+    const std::vector<const TerrainChunk*>& chunks = selection.getChunks();
+    const size_t chunkCount = chunks.size();
+    stats.chunks = chunkCount;
+
+    // Ties broken by selection order, so the frame doesn't depend on the sort
+    struct Ranked {
+        float distance;
+        uint32_t order;
+    };
+    Ranked* ranked = arena.allocate<Ranked>(chunkCount);
+    for (size_t k = 0; k < chunkCount; ++k) {
+        ranked[k] = { chunkDistance(*chunks[k], static_cast<float>(view.tileSize)), static_cast<uint32_t>(k) };
+    }
+    std::sort(ranked, ranked + chunkCount, [](const Ranked& a, const Ranked& b) {
+        return a.distance < b.distance || (a.distance == b.distance && a.order < b.order);
+    });
+    const TerrainChunk** drawOrder = arena.allocate<const TerrainChunk*>(chunkCount);
+    for (size_t k = 0; k < chunkCount; ++k) {
+        drawOrder[k] = chunks[ranked[k].order];
+    }
+    stats.selectSeconds = seconds(start, Clock::now());
+
+    WorkerPool& pool = WorkerPool::shared();
+    size_t passChunks = firstPassChunks;
+    for (size_t first = 0; first < chunkCount; first += passChunks, passChunks = std::min(passChunks * 2, chunksPerPass)) {
+        const size_t count = std::min(first + passChunks, chunkCount) - first;
+        // Batches are only ever added, so each keeps the capacity it grew to
+        if (batches.size() < count) {
+            batches.resize(count);
+        }
+        char* occludedChunk = arena.allocate<char>(count);
+        size_t* occludedTriangles = arena.allocate<size_t>(count);
+
+        start = Clock::now();
+        pool.parallelFor(count, [&](size_t index) {
+            TriangleBatch& batch = batches[index];
+            batch.clear();
+            occludedChunk[index] = 0;
+            occludedTriangles[index] = 0;
+            const TerrainChunk& chunk = *drawOrder[first + index];
+            // The first pass has nothing in front of it
+            if (first > 0 && chunkOccluded(chunk, view)) {
+                occludedChunk[index] = 1;
+                return;
+            }
+            occludedTriangles[index] = emitChunk(chunk, view, batch);
+        });
+        const Clock::time_point setupDone = Clock::now();
+        stats.setupSeconds += seconds(start, setupDone);
+        for (size_t index = 0; index < count; ++index) {
+            stats.triangles += batches[index].size();
+            stats.occludedChunks += occludedChunk[index];
+            stats.occludedTriangles += occludedTriangles[index];
+        }
 
-#pragma omp parallel for
-    for (int j = 0; j < size - 1; ++j) {
-        for (int i = 0; i < size - 1; ++i) {
-            glm::vec3 vertices[6];
+        rasterizer.draw(batches.data(), count, frame, pool);
+        stats.rasterSeconds += seconds(setupDone, Clock::now());
+    }
 
-            vertices[0] = glm::vec3(i * tileSize, j * tileSize, hmap[j][i]);
-            vertices[1] = glm::vec3((i + 1) * tileSize, j * tileSize, hmap[j][i + 1]);
-            vertices[2] = glm::vec3(i * tileSize, (j + 1) * tileSize, hmap[j + 1][i]);
-            vertices[3] = glm::vec3(i * tileSize, (j + 1) * tileSize, hmap[j + 1][i]);
-            vertices[4] = glm::vec3((i + 1) * tileSize, j * tileSize, hmap[j][i + 1]);
-            vertices[5] = glm::vec3((i + 1) * tileSize, (j + 1) * tileSize, hmap[j + 1][i + 1]);
+    Profiler& profiler = Profiler::shared();
+    profiler.addSeconds(ProfileStage::Select, stats.selectSeconds);
+    profiler.addSeconds(ProfileStage::Setup, stats.setupSeconds);
+    profiler.addSeconds(ProfileStage::Raster, stats.rasterSeconds);
+    stats.allocations = allocationCount() - allocationsBefore;
+    return frame.getPixels();
+}
 
-            float simElev_1 = (hmap[j][i] + hmap[j][i + 1] + hmap[j + 1][i]) / 3;
-            simElev_1 = ofMap(simElev_1, -maxElevation, maxElevation, 0, 1);
+const RenderEngine::FrameStats& RenderEngine::getFrameStats() const {
+    return stats;
+}
 
-            float simElev_2 = (hmap[j + 1][i] + hmap[j][i + 1] + hmap[j + 1][i + 1]) / 3;
-            simElev_2 = ofMap(simElev_2, -maxElevation, maxElevation, 0, 1);
+/*
+    Refine a chunk while its error would show as more than maxScreenError pixels,
+    measured at the nearest point of its bounding sphere, and while its children's
+    quads would still be at least minQuadPixels wide there.
+    That keeps the triangle count tied to screen resolution rather than map size.
+*/
+void RenderEngine::selectChunks(const ViewParams& view) {
+    const TerrainQuadtree& tree = fjord->getQuadtree();
+    const int quads = tree.getQuads();
+    const float tileSize = static_cast<float>(view.tileSize);
+    // Zoom scales the map horizontally only
+    const float modelScale = std::max(1.0f, glm::length(glm::vec3(modelMatrix[0])));
+
+    auto bounds = [&](const TerrainChunk& c, glm::vec3& boxMin, glm::vec3& boxMax) {
+        boxMin = glm::vec3(c.x0 * tileSize, c.y0 * tileSize, c.minZ);
+        boxMax = glm::vec3(std::min(c.x0 + c.extent(), quads) * tileSize, std::min(c.y0 + c.extent(), quads) * tileSize, c.maxZ);
+    };
+    auto visible = [&](const TerrainChunk& c) {
+        glm::vec3 boxMin, boxMax;
+        bounds(c, boxMin, boxMax);
+        return intersectsFrustum(view, boxMin, boxMax);
+    };
 
-            glm::vec3 normal_1 = glm::normalize(glm::cross(vertices[1] - vertices[0], vertices[2] - vertices[0]));
-            glm::vec3 normal_2 = glm::normalize(glm::cross(vertices[4] - vertices[3], vertices[5] - vertices[3]));
-            if (glm::length(normal_1) < 1e-6) {
-                normal_1 = glm::vec3(0.0f, 0.0f, 1.0f);
-            }
-            if (glm::length(normal_2) < 1e-6) {
-                normal_2 = glm::vec3(0.0f, 0.0f, 1.0f);
-            }
+    selection.select(tree, fjord->getHeightMap(), visible, [&](const TerrainChunk& c) {
+        const float pixelsPerUnit = lodScale / chunkDistance(c, tileSize);
+        const float childQuadPixels = 0.5f * c.step() * tileSize * modelScale * pixelsPerUnit;
+        return c.level > minLevel && c.error * pixelsPerUnit > maxScreenError && childQuadPixels >= minQuadPixels;
+    });
+}
 
-            for (int k = 0; k < 2; ++k) {
-                glm::vec4 screenCoords[3];
-                glm::vec3* triangleVertices = &vertices[k * 3];
+float RenderEngine::chunkDistance(const TerrainChunk& c, float tileSize) const {
+    const int quads = fjord->getQuadtree().getQuads();
+    // Zoom scales the map horizontally only
+    const float modelScale = std::max(1.0f, glm::length(glm::vec3(modelMatrix[0])));
+    const float x0 = c.x0 * tileSize;
+    const float y0 = c.y0 * tileSize;
+    const float x1 = std::min(c.x0 + c.extent(), quads) * tileSize;
+    const float y1 = std::min(c.y0 + c.extent(), quads) * tileSize;
+    const glm::vec3 centre((x0 + x1) * 0.5f, (y0 + y1) * 0.5f, (c.minZ + c.maxZ) * 0.5f);
+    const glm::vec3 halfSize((x1 - x0) * 0.5f * modelScale, (y1 - y0) * 0.5f * modelScale, (c.maxZ - c.minZ) * 0.5f);
+
+    const glm::vec4 eye = modelView * glm::vec4(centre, 1.0f);
+    return std::max(glm::length(glm::vec3(eye)) - glm::length(halfSize), 1.0f);
+}
 
-                for (int v = 0; v < 3; ++v) {
-                    glm::vec4 worldCoord = glm::vec4(triangleVertices[v], 1.0f);
-                    screenCoords[v] = mvp * worldCoord;
-                    screenCoords[v] /= screenCoords[v].w;
-                    screenCoords[v].x = (screenCoords[v].x + 1.0f) * 0.5f * screenWidth;
-                    screenCoords[v].y = (1.0f - screenCoords[v].y) * 0.5f * screenHeight;
-                }
+/*
+    Gribb-Hartmann: the clip-space tests -w <= x, y, z and x, y <= w, written in model space,
+    are sums and differences of the MVP's rows.
+*/
+void RenderEngine::extractFrustum(ViewParams& view) {
+    const glm::mat4& m = view.mvp;
+    auto row = [&](int r) { return glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]); };
+    view.frustum[0] = row(3) + row(0);
+    view.frustum[1] = row(3) - row(0);
+    view.frustum[2] = row(3) + row(1);
+    view.frustum[3] = row(3) - row(1);
+    view.frustum[4] = row(3) + row(2);
+}
 
-                if (k == 0) {
-                    rasterizeTriangle(screenCoords, zBuffer, i, j, simElev_1, normal_1);
-                }
-                else {
-                    rasterizeTriangle(screenCoords, zBuffer, i, j, simElev_2, normal_2);
-                }
-            }
+/*
+    Projects the chunk's bounding box and tests its screen rectangle at the box's nearest
+    depth against the rasterizer's coarse depth. A box reaching behind the near plane
+    never counts as hidden.
+*/
+bool RenderEngine::chunkOccluded(const TerrainChunk& chunk, const ViewParams& view) const {
+    const int quads = fjord->getQuadtree().getQuads();
+    const float tileSize = static_cast<float>(view.tileSize);
+    const float xs[2] = { chunk.x0 * tileSize, std::min(chunk.x0 + chunk.extent(), quads) * tileSize };
+    const float ys[2] = { chunk.y0 * tileSize, std::min(chunk.y0 + chunk.extent(), quads) * tileSize };
+    const float zs[2] = { chunk.minZ, chunk.maxZ };
+
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, nearZ = FLT_MAX;
+    for (int corner = 0; corner < 8; ++corner) {
+        const glm::vec4 clip = view.mvp * glm::vec4(xs[corner & 1], ys[(corner >> 1) & 1], zs[corner >> 2], 1.0f);
+        if (clip.w < nearPlane) {
+            return false;
         }
+        const float x = (clip.x / clip.w + 1.0f) * 0.5f * view.screenWidth;
+        const float y = (1.0f - clip.y / clip.w) * 0.5f * view.screenHeight;
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        nearZ = std::min(nearZ, clip.z / clip.w);
     }
+    return rasterizer.occluded(minX, minY, maxX, maxY, nearZ);
 }
 
-void RenderEngine::rasterizeTriangle(const glm::vec4 vertices[3], std::vector<std::vector<float>>& zBuffer, int i, int j, float elev, glm::vec3 norm) {
-    int tileSize = fjord->getTileSize();
-    float minX = std::max(0.0f, std::min({ vertices[0].x, vertices[1].x, vertices[2].x }));
-    float maxX = std::min(static_cast<float>(ofGetWidth() - 1), std::max({ vertices[0].x, vertices[1].x, vertices[2].x }));
-    float minY = std::max(0.0f, std::min({ vertices[0].y, vertices[1].y, vertices[2].y }));
-    float maxY = std::min(static_cast<float>(ofGetHeight() - 1), std::max({ vertices[0].y, vertices[1].y, vertices[2].y }));
-
-    glm::vec3 lightDir = glm::normalize(lightPos - glm::vec3(i * tileSize, j * tileSize, elev));
-
-    glm::vec2 v0 = glm::vec2(vertices[1]) - glm::vec2(vertices[0]);
-    glm::vec2 v1 = glm::vec2(vertices[2]) - glm::vec2(vertices[0]);
-    float invDet = 1.0f / (v0.x * v1.y - v0.y * v1.x);
+// Conservative: false only if the box is entirely behind one of the planes
+bool RenderEngine::intersectsFrustum(const ViewParams& view, const glm::vec3& boxMin, const glm::vec3& boxMax) {
+    for (const glm::vec4& plane : view.frustum) {
+        // Corner furthest along the plane normal
+        const glm::vec3 corner(
+            plane.x >= 0 ? boxMax.x : boxMin.x,
+            plane.y >= 0 ? boxMax.y : boxMin.y,
+            plane.z >= 0 ? boxMax.z : boxMin.z);
+        if (plane.x * corner.x + plane.y * corner.y + plane.z * corner.z + plane.w < 0) {
+            return false;
+        }
+    }
+    return true;
+}
 
-#pragma omp parallel for
-    for (int y = static_cast<int>(minY); y <= static_cast<int>(maxY); ++y) {
-        for (int x = static_cast<int>(minX); x <= static_cast<int>(maxX); ++x) {
-            glm::vec2 p = glm::vec2(x, y) - glm::vec2(vertices[0]);
-            float bary1 = (p.x * v1.y - p.y * v1.x) * invDet;
-            float bary2 = (v0.x * p.y - v0.y * p.x) * invDet;
-            float bary0 = 1.0f - bary1 - bary2;
+size_t RenderEngine::emitChunk(const TerrainChunk& chunk, const ViewParams& view, TriangleBatch& out) const {
+    constexpr int maxVertices = TerrainChunk::chunkQuads + 1;
+    const HeightFieldView hmap = fjord->getHeightMap();
+    const int quads = fjord->getQuadtree().getQuads();
+    const int step = chunk.step();
+    const int tileSize = view.tileSize;
+    const int maxElevation = view.maxElevation;
+
+    // Vertex columns and rows; the last ones are clamped to the map edge
+    int xs[maxVertices];
+    int ys[maxVertices];
+    int columns = 0;
+    int rows = 0;
+    for (int k = 0; k < maxVertices; ++k) {
+        xs[columns++] = std::min(chunk.x0 + k * step, quads);
+        if (xs[columns - 1] == quads) {
+            break;
+        }
+    }
+    for (int k = 0; k < maxVertices; ++k) {
+        ys[rows++] = std::min(chunk.y0 + k * step, quads);
+        if (ys[rows - 1] == quads) {
+            break;
+        }
+    }
 
-            if (bary0 >= 0 && bary1 >= 0 && bary2 >= 0) {
-                float depth = bary0 * vertices[0].z + bary1 * vertices[1].z + bary2 * vertices[2].z;
+    /*
+        Border vertices are stitched to coarser neighbours, interior ones read the map.
+        Full resolution chunks read whole rows, which 16-bit maps dequantize in bulk.
+    */
+    float heights[maxVertices][maxVertices];
+    bool moved[maxVertices][maxVertices];
+    float buffer[maxVertices];
+    for (int l = 0; l < rows; ++l) {
+        const float* row = buffer;
+        if (step == 1) {
+            row = hmap.readRow(ys[l], xs[0], columns, buffer);
+        }
+        else {
+            for (int k = 0; k < columns; ++k) {
+                buffer[k] = hmap.at(xs[k], ys[l]);
+            }
+        }
+        for (int k = 0; k < columns; ++k) {
+            const bool border = k == 0 || l == 0 || k == columns - 1 || l == rows - 1;
+            heights[l][k] = border ? selection.stitchedHeight(xs[k], ys[l]) : row[k];
+            moved[l][k] = heights[l][k] != row[k];
+        }
+    }
 
-                if (depth < zBuffer[x][y]) {
-                    zBuffer[x][y] = depth;
+    /*
+        Transform pass: every vertex is projected once, into screen-space arrays the
+        triangles then index, instead of once per triangle using it (up to six times).
+        Sums are grouped the way glm's mat4 * vec4 groups them.
+    */
+    float sx[maxVertices * maxVertices];
+    float sy[maxVertices * maxVertices];
+    float sz[maxVertices * maxVertices];
+    bool inFront[maxVertices * maxVertices];
+    const glm::mat4& m = view.mvp;
+    for (int l = 0; l < rows; ++l) {
+        const float py = static_cast<float>(ys[l] * tileSize);
+        for (int k = 0; k < columns; ++k) {
+            const float px = static_cast<float>(xs[k] * tileSize);
+            const float pz = heights[l][k];
+            const float cx = (m[0][0] * px + m[1][0] * py) + (m[2][0] * pz + m[3][0]);
+            const float cy = (m[0][1] * px + m[1][1] * py) + (m[2][1] * pz + m[3][1]);
+            const float cz = (m[0][2] * px + m[1][2] * py) + (m[2][2] * pz + m[3][2]);
+            const float cw = (m[0][3] * px + m[1][3] * py) + (m[2][3] * pz + m[3][3]);
+            const int v = l * columns + k;
+            // Behind or too close to the camera: the divide would flip or explode its triangles
+            inFront[v] = cw >= nearPlane;
+            sx[v] = (cx / cw + 1.0f) * 0.5f * view.screenWidth;
+            sy[v] = (1.0f - cy / cw) * 0.5f * view.screenHeight;
+            sz[v] = cz / cw;
+        }
+    }
 
-                    float dotProduct = glm::dot(norm, lightDir);
-                    float intensity = glm::clamp(dotProduct, 0.3f, 1.0f);
+    /*
+        Each quad is two simplexes: (x0, y0) (x1, y0) (x0, y1) and (x0, y1) (x1, y0) (x1, y1).
+        Normals come from Fjord's cache unless stitching moved a corner.
+        Quads go from the camera's side of the chunk to the far one, so in each tile
+        nearer terrain tends to be rasterized first and the rest fails the depth test early.
+    */
+    const float* cachedNormals = fjord->getChunkNormals(chunk);
+    const bool farColumnsFirst = view.eye.x > (xs[0] + xs[columns - 1]) * 0.5f * tileSize;
+    const bool farRowsFirst = view.eye.y > (ys[0] + ys[rows - 1]) * 0.5f * tileSize;
+    size_t occluded = 0;
+    for (int n = 0; n + 1 < rows; ++n) {
+        const int l = farRowsFirst ? rows - 2 - n : n;
+        for (int m = 0; m + 1 < columns; ++m) {
+            const int k = farColumnsFirst ? columns - 2 - m : m;
+            const float h[4] = { heights[l][k], heights[l][k + 1], heights[l + 1][k], heights[l + 1][k + 1] };
+            const float* normals = cachedNormals + (l * TerrainChunk::chunkQuads + k) * 6;
+            float stitchedNormals[6];
+            if (moved[l][k] || moved[l][k + 1] || moved[l + 1][k] || moved[l + 1][k + 1]) {
+                quadNormals(xs[k], ys[l], xs[k + 1], ys[l + 1], h, tileSize, stitchedNormals);
+                normals = stitchedNormals;
+            }
 
-#pragma omp critical
-                    {
-                        ofSetColor(calculateColor(elev, intensity));
-                        ofDrawRectangle(x, y, 1, 1);
-                    }
+            const int v00 = l * columns + k;
+            const int v01 = v00 + columns;
+            const int triangles[2][3] = { { v00, v00 + 1, v01 }, { v01, v00 + 1, v01 + 1 } };
+            const float elev[2] = {
+                ofMap((h[0] + h[1] + h[2]) / 3, -maxElevation, maxElevation, 0, 1),
+                ofMap((h[2] + h[1] + h[3]) / 3, -maxElevation, maxElevation, 0, 1)
+            };
+            for (int t = 0; t < 2; ++t) {
+                const int* v = triangles[t];
+                if (!inFront[v[0]] || !inFront[v[1]] || !inFront[v[2]]) {
+                    continue;
+                }
+                ScreenTriangle triangle;
+                for (int i = 0; i < 3; ++i) {
+                    triangle.x[i] = sx[v[i]];
+                    triangle.y[i] = sy[v[i]];
+                    triangle.z[i] = sz[v[i]];
                 }
+                emitTriangle(triangle, xs[k], ys[l], elev[t], normals + 3 * t, out, occluded);
             }
         }
     }
-}
-
-ofColor RenderEngine::calculateColor(float height, float lightIntensity) {
-    static const std::map<int, std::vector<std::tuple<float, float, ofColor, ofColor>>> colorRanges = {
-        {1, {
-            {0.0f, 0.51f, ofColor(0, 0, 255), ofColor(0, 0, 255)},  // Water
-            {0.51f, 0.53f, ofColor(220, 212, 156), ofColor(34, 139, 34)}, // Sand to Grass
-            {0.53f, 0.6f, ofColor(34, 139, 34), ofColor(0, 102, 51)},     // Grass to Forest
-            {0.6f, 0.85f, ofColor(0, 102, 51), ofColor(210, 180, 140)},   // Forest to Earth
-            {0.85f, 0.9f, ofColor(210, 180, 140), ofColor(224, 224, 224)}, // Earth to Grey
-            {0.9f, 1.0f, ofColor(224, 224, 224), ofColor(224, 224, 224)}  // Grey
-        }},
-        {-1, {
-            {0.0f, 0.51f, ofColor(181, 211, 255), ofColor(181, 211, 255)}, // Ice
-            {0.51f, 0.6f, ofColor(0, 102, 51), ofColor(32, 32,32)},       // Grey4 to Grey3
-            {0.6f, 0.75f, ofColor(32, 32, 32), ofColor(224,224, 224)},    // Grey3 to Snow
-            {0.75f, 0.9f, ofColor(224, 224, 224), ofColor(255, 255, 255)}, // Snow
-            {0.9f, 1.0f, ofColor(255, 255, 255), ofColor(255, 255, 255)}   // Snow
-        }}
-    };
 
-    ofColor color = ofColor(192, 192, 192);
-
-    if (height >= 0 && colorRanges.count(mapType)) {
-        const auto& ranges = colorRanges.at(mapType);
-        for (const auto& [low, high, lowColor, highColor] : ranges) {
-            if (height >= low && height < high) {
-                color = interpolateColor(height, low, high, lowColor, highColor);
-                break;
+    /*
+        Stitched borders are T-junctions: our vertices lie on the coarser neighbour's edge in
+        exact arithmetic, but not once projected and snapped, and the rasterizer's fill rule
+        leaves any pixel in the gap to nobody. Fan sliver triangles from each coarse vertex
+        over our vertices up to the next one: they share exact screen edges with both meshes.
+    */
+    auto fillBorder = [&](bool vertical, int fixed) {
+        const int count = vertical ? rows : columns;
+        const int across = vertical ? xs[fixed] : ys[fixed];
+        auto along = [&](int i) { return vertical ? ys[i] : xs[i]; };
+        auto vertex = [&](int i) { return vertical ? i * columns + fixed : fixed * columns + i; };
+        for (int first = 0; first + 1 < count;) {
+            const int coarse = selection.stitchStep(across, along(first + 1), vertical);
+            auto onCoarseGrid = [&](int i) { return along(i) % coarse == 0 || along(i) == quads; };
+            if (coarse == 0 || onCoarseGrid(first + 1)) {
+                ++first;
+                continue;
+            }
+            int last = first + 1;
+            while (last + 1 < count && !onCoarseGrid(last)) {
+                ++last;
+            }
+            for (int i = first + 1; i < last; ++i) {
+                const int v[3] = { vertex(first), vertex(i), vertex(i + 1) };
+                if (!inFront[v[0]] || !inFront[v[1]] || !inFront[v[2]]) {
+                    continue;
+                }
+                ScreenTriangle triangle;
+                for (int n = 0; n < 3; ++n) {
+                    triangle.x[n] = sx[v[n]];
+                    triangle.y[n] = sy[v[n]];
+                    triangle.z[n] = sz[v[n]];
+                }
+                // The gap can open on either side of the coarse edge; face it forward
+                if ((triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) - (triangle.y[1] - triangle.y[0]) * (triangle.x[2] - triangle.x[0]) > 0) {
+                    std::swap(triangle.x[1], triangle.x[2]);
+                    std::swap(triangle.y[1], triangle.y[2]);
+                    std::swap(triangle.z[1], triangle.z[2]);
+                }
+                // Shaded like our quad along that stretch of the border
+                const int k = vertical ? std::min(fixed, columns - 2) : i;
+                const int l = vertical ? i : std::min(fixed, rows - 2);
+                const float h[4] = { heights[l][k], heights[l][k + 1], heights[l + 1][k], heights[l + 1][k + 1] };
+                float normals[6];
+                quadNormals(xs[k], ys[l], xs[k + 1], ys[l + 1], h, tileSize, normals);
+                const float elev = ofMap((h[0] + h[1] + h[2]) / 3, -maxElevation, maxElevation, 0, 1);
+                emitTriangle(triangle, xs[k], ys[l], elev, normals, out, occluded);
             }
+            first = last;
         }
-        color.r = static_cast<unsigned char>(color.r * lightIntensity);
-        color.g = static_cast<unsigned char>(color.g * lightIntensity);
-        color.b = static_cast<unsigned char>(color.b * lightIntensity);
+    };
+    if (rows > 1 && columns > 1) {
+        fillBorder(true, 0);
+        fillBorder(true, columns - 1);
+        fillBorder(false, 0);
+        fillBorder(false, rows - 1);
     }
-
-    return color;
+    return occluded;
 }
 
-ofColor RenderEngine::interpolateColor(float elev, float l, float h, ofColor lc, ofColor hc) {
-    ofColor c;
-    c.r = ofMap(elev, l, h, lc.r, hc.r, true);
-    c.g = ofMap(elev, l, h, lc.g, hc.g, true);
-    c.b = ofMap(elev, l, h, lc.b, hc.b, true);
+void RenderEngine::emitTriangle(ScreenTriangle& t, int i, int j, float elev, const float normal[3], TriangleBatch& out, size_t& occluded) const {
+    /*
+        Both triangles of a quad wind counter-clockwise seen from above, which the y-down
+        screen mapping turns clockwise: negative area. Anything else faces away (or is edge-on).
+    */
+    const float area = (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (t.y[1] - t.y[0]) * (t.x[2] - t.x[0]);
+    if (!(area < 0.0f)) {
+        return;
+    }
+    if (!coversSamples(t, frame.getWidth(), frame.getHeight())) {
+        return;
+    }
+    // Hidden triangles are dropped here, before the lighting below is paid for
+    if (rasterizer.occluded(std::min({ t.x[0], t.x[1], t.x[2] }), std::min({ t.y[0], t.y[1], t.y[2] }),
+        std::max({ t.x[0], t.x[1], t.x[2] }), std::max({ t.y[0], t.y[1], t.y[2] }), std::min({ t.z[0], t.z[1], t.z[2] }))) {
+        ++occluded;
+        return;
+    }
 
-    return c;
+    // Lighting is constant over a triangle, so shade once here instead of per pixel
+    int tileSize = fjord->getTileSize();
+    glm::vec3 lightDir = glm::normalize(lightPos - glm::vec3(i * tileSize, j * tileSize, elev));
+    float dotProduct = glm::dot(glm::vec3(normal[0], normal[1], normal[2]), lightDir);
+    float intensity = glm::clamp(dotProduct, 0.3f, 1.0f);
+    t.color = palette->shade(elev, intensity);
+    out.push_back(t);
 }
 
-
-
-glm::mat4 RenderEngine::setupProjection() {
+glm::mat4 RenderEngine::setupProjection(int width, int height) {
     /*
     Calculate Model-View-Projection matrix.
     It's used to project landscape to a screen with perspective and transform.
@@ -195,9 +569,9 @@ glm::mat4 RenderEngine::setupProjection() {
         float np;
         float fp;
     } projConf = {
-        static_cast<float>(ofGetWidth()) / ofGetHeight(),
+        static_cast<float>(width) / height,
         50.0f,
-        1.0f,
+        nearPlane,
         1000.0f
     };
     glm::mat4 projection = glm::perspective(glm::radians(projConf.fov), projConf.ratio, projConf.np, projConf.fp);
@@ -212,12 +586,16 @@ glm::mat4 RenderEngine::setupProjection() {
     glm::mat4 view = glm::lookAt(cameraPos, cameraTarget, upVector);
 
     lightPos = cameraPos;
+    modelView = view * modelMatrix;
+    lodScale = height / (2.0f * std::tan(glm::radians(projConf.fov) * 0.5f));
 
     return projection * view * modelMatrix;
 }
 
 void RenderEngine::changeMapType() {
     mapType = -mapType;
+    palette = &Palette::forMapType(mapType);
+    dirty = true;
 }
 
 void RenderEngine::rotate(bool clockwise) {
@@ -236,6 +614,8 @@ void RenderEngine::rotate(bool clockwise) {
     glm::mat4 translateBack = glm::translate(glm::mat4(1.0f), center);
 
     modelMatrix = translateBack * rotateMatrix * translateToOrigin * modelMatrix;
+    noteInput();
+    dirty = true;
 }
 
 void RenderEngine::zoom(bool zoomIn) {
@@ -256,4 +636,6 @@ void RenderEngine::zoom(bool zoomIn) {
     glm::mat4 translateBack = glm::translate(glm::mat4(1.0f), center);
 
     modelMatrix = translateBack * scaleMatrix * translateToOrigin * modelMatrix;
+    noteInput();
+    dirty = true;
 }
\ No newline at end of file
@@ -4,16 +4,25 @@
 #include "ofMain.h"
 #include "ofVec3f.h"
 #include "fjord.h"
+#include "builder.h"
 #include "generator.h"
 #include "noise.h"
+#include "framebuffer.h"
+#include "raster.h"
+#include "arena.h"
+#include "palette.h"
+#include "terrain.h"
 #include <vector>
 #include <cmath>
 #include <math.h>
+#include <chrono>
 #include <functional>
 
 class RenderEngine {
 private:
+	// Front buffer: what render() draws; requestUpdate() builds into the builder's back buffer
 	std::unique_ptr<Fjord> fjord;
+	FjordBuilder builder;
 
 	glm::mat4 modelMatrix;
 	glm::vec3 translation;
@@ -22,20 +31,167 @@ private:
 	glm::vec3 lightPos;
 	float scaleFactor;
 	int mapType = 1;
+	// Baked colours for mapType, swapped by changeMapType()
+	const Palette* palette = &Palette::forMapType(1);
 
-	void rasterizeTriangle(const glm::vec4 vertices[3], std::vector<std::vector<float>>& zBuffer, int i, int j, float elev, glm::vec3 norm);
-	glm::mat4 setupProjection();
-	ofColor calculateColor(float height, float lightIntensity);
-	ofColor interpolateColor(float elev, float l, float h, ofColor lc, ofColor hc);
+	FrameBuffer frame;
+	ofTexture frameTexture;
+	ofColor background = ofColor(50, 50, 50);
+
+	TileRasterizer rasterizer;
+	// One per chunk of the largest pass so far; cleared, never freed, between passes
+	std::vector<TriangleBatch> batches;
+	// Per-frame scratch: chunk order and per-pass occlusion counts
+	FrameArena arena;
+
+	/*
+		Level of detail: chunks are refined until their height error is below maxScreenError
+		pixels, or their children's quads would be smaller than minQuadPixels.
+	*/
+	static constexpr float maxScreenError = 1.0f;
+	static constexpr float minQuadPixels = 1.0f;
+	// 32 x 32 quads, 2 triangles each: ~1M triangles per pass
+	static constexpr size_t chunksPerPass = 512;
+	/*
+		Chunks are drawn front to back in passes that double in size from this one,
+		each culled against the coarse depth left by the passes before it.
+	*/
+	static constexpr size_t firstPassChunks = 16;
+	TerrainSelection selection;
+	// Set by setupProjection() for LOD selection
+	glm::mat4 modelView;
+	float lodScale = 1;
+
+	/*
+		Progressive mode: camera and landscape input drop selection to chunks of level
+		progressiveLevels and up, i.e. every 8th height, until input has paused for settleSeconds;
+		then each frame allows one level finer. Coarse chunks are quadtree levels built with the map
+		and their face normals stay cached in Fjord, so refining frames reuse both.
+	*/
+	static constexpr int progressiveLevels = 3;
+	static constexpr double settleSeconds = 0.1;
+	bool progressive = false;
+	// Finest level selectChunks() may pick
+	int minLevel = 0;
+	std::chrono::steady_clock::time_point lastInput;
+
+	// Fraction of the map one pan() step moves the streamed window by
+	static constexpr double panStep = 0.25;
+
+	// Per-frame constants for triangle setup
+	struct ViewParams {
+		glm::mat4 mvp;
+		/*
+			Left, right, bottom, top and near planes in model space: inside is dot(plane, (p, 1)) >= 0.
+			No far plane: the projection's far distance is shorter than the map.
+		*/
+		glm::vec4 frustum[5];
+		// Camera position in model space
+		glm::vec3 eye;
+		float screenWidth;
+		float screenHeight;
+		int tileSize;
+		int maxElevation;
+	};
+
+	// Set by anything that changes the picture; cleared once the frame is in frameTexture
+	bool dirty = true;
+
+public:
+	// Counts and stage timings of the last renderFrame()
+	struct FrameStats {
+		size_t chunks = 0;
+		size_t triangles = 0;
+		// Skipped whole, or before shading, as hidden behind earlier passes
+		size_t occludedChunks = 0;
+		size_t occludedTriangles = 0;
+		// Finest level selection could pick, above 0 in progressive frames
+		int minLevel = 0;
+		double selectSeconds = 0;
+		double setupSeconds = 0;
+		double rasterSeconds = 0;
+		/*
+			Heap allocations during the frame, 0 once warmed up; see allocationCount().
+			Process-wide, so a background build running meanwhile shows up too.
+		*/
+		uint64_t allocations = 0;
+	};
+
+private:
+	FrameStats stats;
+
+	void selectChunks(const ViewParams& view);
+	// Eye-space distance from the camera to the chunk's bounding sphere, at least 1
+	float chunkDistance(const TerrainChunk& c, float tileSize) const;
+	static void extractFrustum(ViewParams& view);
+	static bool intersectsFrustum(const ViewParams& view, const glm::vec3& boxMin, const glm::vec3& boxMax);
+	// Whether the chunk's bounding box is hidden behind what earlier passes drew
+	bool chunkOccluded(const TerrainChunk& chunk, const ViewParams& view) const;
+	// Returns how many of the chunk's triangles were occluded
+	size_t emitChunk(const TerrainChunk& chunk, const ViewParams& view, TriangleBatch& out) const;
+	// Culls, shades and appends a projected triangle; counts it in 'occluded' if hidden
+	void emitTriangle(ScreenTriangle& t, int i, int j, float elev, const float normal[3], TriangleBatch& out, size_t& occluded) const;
+	glm::mat4 setupProjection(int width, int height);
+	// Starts a run of coarse frames in progressive mode
+	void noteInput();
+	// Steps minLevel towards full resolution once input has settled; true if it moved
+	bool refineProgressive();
+	// Near clip distance; triangles with a vertex closer than this are dropped, not clipped
+	static constexpr float nearPlane = 1.0f;
 
 public:
-	RenderEngine(std::unique_ptr<HeightGenerator_Creator> generator_creator, std::function<float(float, float)>);
+	RenderEngine(std::unique_ptr<HeightGenerator_Creator> generator_creator);
+	/*
+		Draws the landscape into the window.
+		Re-renders (renderFrame() at window size + one texture upload) only when
+		the camera, landscape, palette or window size changed since the last frame;
+		otherwise re-presents the cached texture.
+	*/
 	void render();
+	// Forces the next render() to redraw
+	void invalidate();
+	/*
+		Coarse frames while rotate(), zoom(), pan() or requestUpdate() calls keep coming,
+		refined over the next frames once they stop. Off by default, so headless
+		renders always come out at full resolution.
+	*/
+	void setProgressive(bool progressive);
+	/*
+		Rasterizes into the CPU framebuffer only, no GL calls.
+		Usable headless, e.g. for batch rendering and regression screenshots.
+	*/
+	const ofPixels& renderFrame(int width, int height);
+	bool saveFrame(const std::string& path, int width, int height);
+	const FrameStats& getFrameStats() const;
+	// Rebuilds the landscape before returning, superseding any requestUpdate() in flight
 	void update(
 		bool _regen = true, int octave = 8, int seed = 0,
 		int maxElevation = 3000, int tileSize = 20, bool isLake = false, float waterPercentage = 0.5
 	);
+	/*
+		Like update(), but new noise is generated in the background: render() keeps drawing
+		the current landscape and switches over once the build is done. A newer request
+		cancels an older one. Remapping already generated noise and streaming stay synchronous.
+	*/
+	void requestUpdate(
+		bool _regen = true, int octave = 8, int seed = 0,
+		int maxElevation = 3000, int tileSize = 20, bool isLake = false, float waterPercentage = 0.5
+	);
+	// Whether a requestUpdate() hasn't reached the screen yet
+	bool isUpdating() const;
 	void changeMapType();
+	/*
+		Streaming turns the fixed map into a window over an endless world that pan() moves;
+		chunks generate in the background and show up as they arrive. Takes effect on the next update().
+	*/
+	void setStreaming(bool streaming);
+	// 16-bit height map, see Fjord::setQuantized(). Takes effect on the next update().
+	void setQuantized(bool quantized);
+	void pan(int dx, int dy);
+	// Large maps are cached here across sessions, see Fjord::setCacheDirectory()
+	void setCacheDirectory(const std::string& directory);
+	// See Fjord::exportTerrain()
+	bool exportTerrain(const std::string& path) const;
 	void rotate(bool clockwise);
 	void zoom(bool zoomIn);
 };
\ No newline at end of file
@@ -1,7 +1,12 @@
 ﻿#include "ofApp.h"
+#include "../profiler.h"
+
 void ofApp::setup() {
     auto generatorCreator = std::make_unique<OctaveGenerator_Creator>();
-    renderEngine = std::make_unique<RenderEngine>(std::move(generatorCreator), noise);
+    renderEngine = std::make_unique<RenderEngine>(std::move(generatorCreator));
+    renderEngine->setCacheDirectory(ofToDataPath("heightmaps", true));
+    // Coarse frames while arrow keys are held or sliders dragged
+    renderEngine->setProgressive(true);
 
     ofSetWindowTitle("Landscape Visualizer");
     ofSetFrameRate(60);
@@ -42,6 +47,14 @@ void ofApp::setupGUI() {
     gui.add(lakeSizeSlider.setup("", 0.5f, 0.0f, 1.0f, 400, 50));
     lakeSizeSlider.addListener(this, &ofApp::onLakeSizeChanged);
     gui.add(other.setup("", "Use keyboard arrows to zoom and rotate", 600, 50));
+    gui.add(exportLabel.setup("", "Press E to export height maps, M for meshes", 600, 50));
+    gui.add(profilerLabel.setup("", "Press P for frame timings, C to save them as CSV", 600, 50));
+
+    gui.add(streamToggle.setup("Toggle to stream an endless world (WASD to pan)", false, 400, 50));
+    streamToggle.addListener(this, &ofApp::onStreamChanged);
+
+    gui.add(quantizeToggle.setup("Toggle to store heights in 16 bits (half the memory)", false, 400, 50));
+    quantizeToggle.addListener(this, &ofApp::onQuantizeChanged);
 
 
 }
@@ -50,7 +63,18 @@ void ofApp::onIsLakeChanged(bool& value) {
     isLake = value;
     _regen = true;
     seed = ofRandom(1, 10000);
-    updateLandscapeSettings();
+    needsRedraw = true;
+}
+
+void ofApp::onStreamChanged(bool& value) {
+    renderEngine->setStreaming(value);
+    _regen = false;
+    needsRedraw = true;
+}
+
+void ofApp::onQuantizeChanged(bool& value) {
+    renderEngine->setQuantized(value);
+    _regen = false;
     needsRedraw = true;
 }
 
@@ -66,14 +90,12 @@ void ofApp::onLakeSizeChanged(float& value) {
     waterPercentage = value;
     _regen = true;
     seed = ofRandom(1, 10000);
-    updateLandscapeSettings();
     needsRedraw = true;
 }
 
 void ofApp::onRegeneratePressed() {
     seed = ofRandom(1, 10000);
     _regen = true;
-    updateLandscapeSettings();
     needsRedraw = true;
 }
 
@@ -94,37 +116,45 @@ void ofApp::onScaleFactorChanged(int& value) {
     needsRedraw = true;
 }
 
-void ofApp::updateLandscapeSettings() {
-    if (needsRedraw) {
-        needsRedraw = false;
+void ofApp::draw() {
+    {
+        ProfileScope profile(ProfileStage::Draw);
+        ofBackground(50, 50, 50);
+        if (needsRedraw) {
+            // Generation runs in the background, the current landscape stays up meanwhile
+            renderEngine->requestUpdate(
+                _regen,
+                octave,
+                seed,
+                maxElevation,
+                tileSize,
+                isLake,
+                waterPercentage
+            );
+            needsRedraw = false;
+        }
+        renderEngine->render();
+        ProfileScope guiProfile(ProfileStage::Gui);
+        gui.draw();
+    }
+    if (showProfiler) {
+        drawProfiler();
     }
-    renderEngine->update(
-        _regen,
-        octave,
-        seed,
-        maxElevation,
-        tileSize,
-        isLake,
-        waterPercentage
-    );
+    Profiler::shared().endFrame();
 }
 
-void ofApp::draw() {
-    ofBackground(50, 50, 50);
-    if (needsRedraw) {
-        renderEngine->update(
-            _regen,
-            octave,
-            seed,
-            maxElevation,
-            tileSize,
-            isLake,
-            waterPercentage
-        );
-        needsRedraw = false;
+void ofApp::drawProfiler() {
+    // Right of the panel: one line per stage, rolling percentiles in milliseconds
+    const Profiler& profiler = Profiler::shared();
+    const float x = gui.getPosition().x + gui.getWidth() + 20;
+    float y = gui.getPosition().y + 20;
+    ofDrawBitmapStringHighlight("stage            p50     p95     p99 ms", x, y);
+    for (size_t s = 0; s < Profiler::stageCount; ++s) {
+        const ProfileStage stage = static_cast<ProfileStage>(s);
+        const Profiler::Percentiles p = profiler.percentiles(stage);
+        y += 18;
+        ofDrawBitmapStringHighlight(ofVAArgsToString("%-14s %7.2f %7.2f %7.2f", Profiler::stageName(stage), p.p50, p.p95, p.p99), x, y);
     }
-    renderEngine->render();
-    gui.draw();
 }
 
 void ofApp::keyPressed(int key) {
@@ -144,5 +174,45 @@ void ofApp::keyPressed(int key) {
     case OF_KEY_RIGHT:
         renderEngine->rotate(true);
         break;
+    case 'w':
+        renderEngine->pan(0, -1);
+        break;
+    case 's':
+        renderEngine->pan(0, 1);
+        break;
+    case 'a':
+        renderEngine->pan(-1, 0);
+        break;
+    case 'd':
+        renderEngine->pan(1, 0);
+        break;
+    case 'e':
+        for (const char* name : { "export/terrain.png", "export/terrain.r16", "export/terrain.pfm" }) {
+            if (!renderEngine->exportTerrain(ofToDataPath(name, true))) {
+                ofLogError("ofApp") << "export failed: " << name;
+            }
+        }
+        break;
+    case 'p':
+        showProfiler = !showProfiler;
+        break;
+    case 'c': {
+        const std::string path = ofToDataPath("profile/frames-" + ofGetTimestampString() + ".csv", true);
+        if (!Profiler::shared().writeCsv(path)) {
+            ofLogError("ofApp") << "can't write " << path;
+        }
+        break;
+    }
+    case 'm':
+        for (const char* name : { "export/terrain.obj", "export/terrain.ply" }) {
+            if (!renderEngine->exportTerrain(ofToDataPath(name, true))) {
+                ofLogError("ofApp") << "export failed: " << name;
+            }
+        }
+        break;
     }
+}
+
+void ofApp::windowResized(int w, int h) {
+    renderEngine->invalidate();
 }
\ No newline at end of file
@@ -19,6 +19,8 @@ private:
     ofxButton regenerateButton;
     ofxButton changeTexture;
     ofxToggle isLakeToggle;
+    ofxToggle streamToggle;
+    ofxToggle quantizeToggle;
 
 
 
@@ -29,11 +31,14 @@ private:
     ofxLabel lakeSizeLabel;
     ofxLabel updateLabel;
     ofxLabel other; 
+    ofxLabel exportLabel;
+    ofxLabel profilerLabel;
 
 
 
 
     bool needsRedraw = true;
+    bool showProfiler = false;
 
     bool _regen = true;
     int octave = 8;
@@ -45,7 +50,7 @@ private:
 
 
     void setupGUI();
-    void updateLandscapeSettings();
+    void drawProfiler();
 
 public:
     void onTileSizeChanged(int& value);
@@ -55,8 +60,11 @@ public:
     void onLakeSizeChanged(float& value);
     void onTexturePressed();
     void onIsLakeChanged(bool& value);
+    void onStreamChanged(bool& value);
+    void onQuantizeChanged(bool& value);
     void setup();
     void draw();
 
     void keyPressed(int key);
+    void windowResized(int w, int h);
 };
\ No newline at end of file
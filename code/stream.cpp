@@ -0,0 +1,192 @@
+#include "stream.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+long long floorDiv(long long a, long long b) {
+    return a / b - ((a % b != 0) && ((a < 0) != (b < 0)));
+}
+
+}
+
+size_t TerrainStream::KeyHash::operator()(const Key& k) const {
+    uint64_t h = 1469598103934665603ULL;
+    for (const uint64_t v : { uint64_t(k.seed), uint64_t(k.octave), uint64_t(k.size), uint64_t(k.cx), uint64_t(k.cy) }) {
+        h = (h ^ v) * 1099511628211ULL;
+    }
+    return static_cast<size_t>(h);
+}
+
+TerrainStream::TerrainStream(std::unique_ptr<HeightGenerator> generator, size_t memoryBudget)
+    : generator{ std::move(generator) }, memoryBudget{ memoryBudget } {
+    loader = std::thread(&TerrainStream::loaderLoop, this);
+}
+
+TerrainStream::~TerrainStream() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    loader.join();
+}
+
+void TerrainStream::setWindow(int seed, int octave, int size, long long x0, long long y0, size_t width, size_t height) {
+    const long long x1 = x0 + static_cast<long long>(width) - 1;
+    const long long y1 = y0 + static_cast<long long>(height) - 1;
+    std::vector<Key> missing;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++windowCount;
+        windowFirst = Key{ seed, octave, size, floorDiv(x0, chunkQuads), floorDiv(y0, chunkQuads) };
+        windowLastX = width > 0 && height > 0 ? floorDiv(x1, chunkQuads) : windowFirst.cx - 1;
+        windowLastY = width > 0 && height > 0 ? floorDiv(y1, chunkQuads) : windowFirst.cy - 1;
+        for (long long cy = windowFirst.cy; cy <= windowLastY; ++cy) {
+            for (long long cx = windowFirst.cx; cx <= windowLastX; ++cx) {
+                const Key key{ seed, octave, size, cx, cy };
+                const auto found = chunks.find(key);
+                if (found == chunks.end()) {
+                    missing.push_back(key);
+                    continue;
+                }
+                found->second.lastWindow = windowCount;
+                lru.splice(lru.begin(), lru, found->second.lru);
+            }
+        }
+
+        // Nearest to the window centre first
+        const double centreX = (x0 + x1) * 0.5 / chunkQuads - 0.5;
+        const double centreY = (y0 + y1) * 0.5 / chunkQuads - 0.5;
+        std::sort(missing.begin(), missing.end(), [&](const Key& a, const Key& b) {
+            const double da = (a.cx - centreX) * (a.cx - centreX) + (a.cy - centreY) * (a.cy - centreY);
+            const double db = (b.cx - centreX) * (b.cx - centreX) + (b.cy - centreY) * (b.cy - centreY);
+            return da < db;
+        });
+        queue.assign(missing.rbegin(), missing.rend());
+    }
+    wake.notify_one();
+}
+
+void TerrainStream::copy(long long x0, long long y0, size_t width, size_t height, HeightField& out, size_t outX, size_t outY) {
+    if (width == 0 || height == 0) {
+        return;
+    }
+    const long long x1 = x0 + static_cast<long long>(width) - 1;
+    const long long y1 = y0 + static_cast<long long>(height) - 1;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (long long cy = floorDiv(y0, chunkQuads); cy <= floorDiv(y1, chunkQuads); ++cy) {
+        for (long long cx = floorDiv(x0, chunkQuads); cx <= floorDiv(x1, chunkQuads); ++cx) {
+            Key key = windowFirst;
+            key.cx = cx;
+            key.cy = cy;
+            // Overlap of the region with the chunk's [0; chunkQuads) points
+            const long long sx0 = std::max(x0, cx * chunkQuads);
+            const long long sy0 = std::max(y0, cy * chunkQuads);
+            const long long sx1 = std::min(x1, cx * chunkQuads + chunkQuads - 1);
+            const long long sy1 = std::min(y1, cy * chunkQuads + chunkQuads - 1);
+            const size_t runLength = static_cast<size_t>(sx1 - sx0 + 1);
+            const size_t column = outX + static_cast<size_t>(sx0 - x0);
+
+            const auto found = chunks.find(key);
+            for (long long y = sy0; y <= sy1; ++y) {
+                float* row = out.row(outY + static_cast<size_t>(y - y0)) + column;
+                if (found == chunks.end()) {
+                    std::fill_n(row, runLength, 0.0f);
+                    continue;
+                }
+                const float* src = found->second.heights.row(static_cast<size_t>(y - cy * chunkQuads)) + (sx0 - cx * chunkQuads);
+                std::memcpy(row, src, runLength * sizeof(float));
+            }
+        }
+    }
+}
+
+std::vector<TerrainStream::ChunkCoord> TerrainStream::takeArrivals() {
+    std::lock_guard<std::mutex> lock(mutex);
+    // Arrivals outlive setWindow so chunks that stay in a scrolled window still get copied
+    std::vector<ChunkCoord> taken;
+    for (const Key& key : arrivals) {
+        if (inWindow(key)) {
+            taken.push_back({ key.cx, key.cy });
+        }
+    }
+    arrivals.clear();
+    return taken;
+}
+
+bool TerrainStream::inWindow(const Key& key) const {
+    return key.seed == windowFirst.seed && key.octave == windowFirst.octave && key.size == windowFirst.size
+        && key.cx >= windowFirst.cx && key.cx <= windowLastX && key.cy >= windowFirst.cy && key.cy <= windowLastY;
+}
+
+void TerrainStream::loaderLoop() {
+    int lastSeed = 0;
+    bool seeded = false;
+    for (;;) {
+        Key key;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || !queue.empty(); });
+            if (stopping) {
+                return;
+            }
+            key = queue.back();
+            queue.pop_back();
+        }
+
+        // Only this thread touches the generator
+        generator->reconfigure(!seeded || key.seed != lastSeed, key.octave, key.seed);
+        lastSeed = key.seed;
+        seeded = true;
+        HeightField heights;
+        generateChunk(key, heights);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (chunks.count(key) == 0) {
+                const size_t bytes = heights.getStride() * heights.getHeight() * sizeof(float);
+                lru.push_front(key);
+                Chunk& chunk = chunks[key];
+                chunk.heights = std::move(heights);
+                chunk.lru = lru.begin();
+                memoryUsed += bytes;
+                // Chunks panned away from while generating are kept but not reported
+                if (inWindow(key)) {
+                    chunk.lastWindow = windowCount;
+                    arrivals.push_back(key);
+                }
+                evict();
+            }
+        }
+    }
+}
+
+void TerrainStream::generateChunk(const Key& key, HeightField& heights) {
+    const size_t points = chunkQuads;
+    generator->generateRegion(key.cx * chunkQuads, key.cy * chunkQuads, points, points, key.size, heights);
+
+    const float bound = generator->getNoiseBound();
+    const float scale = bound > 0.0f ? 1.0f / bound : 0.0f;
+    for (size_t y = 0; y < points; ++y) {
+        float* row = heights.row(y);
+        for (size_t x = 0; x < points; ++x) {
+            row[x] *= scale;
+        }
+    }
+}
+
+void TerrainStream::evict() {
+    while (memoryUsed > memoryBudget && !lru.empty()) {
+        const auto found = chunks.find(lru.back());
+        // Everything older is in use too; let the cache grow until the window moves
+        if (found->second.lastWindow == windowCount) {
+            break;
+        }
+        const HeightField& heights = found->second.heights;
+        memoryUsed -= heights.getStride() * heights.getHeight() * sizeof(float);
+        chunks.erase(found);
+        lru.pop_back();
+    }
+}
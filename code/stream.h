@@ -0,0 +1,100 @@
+#pragma once
+
+#include "generator.h"
+#include "heightfield.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/*
+	Endless terrain as fixed-size chunks of normalized noise, generated on demand.
+	A chunk holds chunkQuads^2 points of the grid generate(size) samples. Every point depends
+	only on its grid position, and chunks are normalized by the generator's fixed noise bound
+	instead of per-map min/max, so they line up seamlessly whenever they were generated.
+	Missing chunks are generated on a loader thread; loaded ones are kept in an LRU cache
+	bounded by 'memoryBudget', never evicting chunks the current window still uses.
+*/
+class TerrainStream {
+public:
+	static constexpr int chunkQuads = 256;
+
+	explicit TerrainStream(std::unique_ptr<HeightGenerator> generator, size_t memoryBudget = size_t(256) << 20);
+	~TerrainStream();
+	TerrainStream(const TerrainStream&) = delete;
+	TerrainStream& operator=(const TerrainStream&) = delete;
+
+	struct ChunkCoord {
+		long long cx;
+		long long cy;
+	};
+
+	/*
+		Sets the window of width x height grid points starting at (x0, y0) that copy() reads.
+		Its chunks that aren't loaded yet are queued, nearest to the window centre first;
+		the queue is replaced on every call, so chunks panned away from are never generated.
+		Chunks in the window are never evicted.
+	*/
+	void setWindow(int seed, int octave, int size, long long x0, long long y0, size_t width, size_t height);
+	/*
+		Copies the width x height points starting at grid point (x0, y0) of the window's grid
+		into 'out' at (outX, outY). Chunks that aren't loaded yet read as 0.
+	*/
+	void copy(long long x0, long long y0, size_t width, size_t height, HeightField& out, size_t outX, size_t outY);
+	/*
+		Chunks of the current window that finished loading since the last call, so the
+		caller can copy() just those. Their points span [c * chunkQuads; (c + 1) * chunkQuads).
+	*/
+	std::vector<ChunkCoord> takeArrivals();
+
+private:
+	struct Key {
+		int seed;
+		int octave;
+		int size;
+		long long cx;
+		long long cy;
+		bool operator==(const Key& other) const {
+			return seed == other.seed && octave == other.octave && size == other.size && cx == other.cx && cy == other.cy;
+		}
+	};
+	struct KeyHash {
+		size_t operator()(const Key& k) const;
+	};
+	struct Chunk {
+		HeightField heights;
+		std::list<Key>::iterator lru;
+		// windowCount when last in the window
+		uint64_t lastWindow = 0;
+	};
+
+	std::unique_ptr<HeightGenerator> generator;
+	size_t memoryBudget;
+	size_t memoryUsed = 0;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::unordered_map<Key, Chunk, KeyHash> chunks;
+	// Most recently used first
+	std::list<Key> lru;
+	std::vector<Key> queue;
+	// Chunk range of the current window, inclusive, and its generator settings
+	Key windowFirst{};
+	long long windowLastX = -1;
+	long long windowLastY = -1;
+	uint64_t windowCount = 0;
+	// Loaded since the last takeArrivals(), possibly for an earlier window
+	std::vector<Key> arrivals;
+	bool stopping = false;
+	std::thread loader;
+
+	bool inWindow(const Key& key) const;
+	void loaderLoop();
+	void generateChunk(const Key& key, HeightField& heights);
+	void evict();
+};
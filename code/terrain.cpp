@@ -0,0 +1,339 @@
+#include "terrain.h"
+#include "workers.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+void TerrainQuadtree::build(const HeightFieldView& heights, int quads) {
+    ProfileScope profile(ProfileStage::Quadtree);
+    this->quads = quads;
+    levels.clear();
+    if (quads <= 0 || heights.empty()) {
+        return;
+    }
+    buildLeaves(heights);
+    while (cells(getLevels() - 1) > 1) {
+        buildLevel(heights, getLevels());
+    }
+}
+
+void TerrainQuadtree::buildLeaves(const HeightFieldView& heights) {
+    const int n = cells(0);
+    levels.emplace_back(static_cast<size_t>(n) * n);
+    std::vector<TerrainChunk>& leaves = levels.back();
+
+    WorkerPool::shared().parallelFor(leaves.size(), [&](size_t index) {
+        TerrainChunk& c = leaves[index];
+        c.index = static_cast<uint32_t>(index);
+        c.x0 = static_cast<int>(index % n) * TerrainChunk::chunkQuads;
+        c.y0 = static_cast<int>(index / n) * TerrainChunk::chunkQuads;
+        c.level = 0;
+        computeLeaf(heights, c);
+    });
+}
+
+void TerrainQuadtree::buildLevel(const HeightFieldView& heights, int level) {
+    const int n = cells(level);
+    const size_t first = getChunkCount();
+    levels.emplace_back(static_cast<size_t>(n) * n);
+    std::vector<TerrainChunk>& chunks = levels.back();
+
+    WorkerPool::shared().parallelFor(chunks.size(), [&](size_t index) {
+        TerrainChunk& c = chunks[index];
+        c.level = level;
+        c.index = static_cast<uint32_t>(first + index);
+        c.x0 = static_cast<int>(index % n) * c.extent();
+        c.y0 = static_cast<int>(index / n) * c.extent();
+        computeChunk(heights, c);
+    });
+}
+
+void TerrainQuadtree::computeLeaf(const HeightFieldView& heights, TerrainChunk& c) const {
+    const int x1 = std::min(c.x0 + TerrainChunk::chunkQuads, quads);
+    const int y1 = std::min(c.y0 + TerrainChunk::chunkQuads, quads);
+    float buffer[TerrainChunk::chunkQuads + 1];
+    c.error = 0;
+    c.minZ = c.maxZ = heights.at(c.x0, c.y0);
+    for (int y = c.y0; y <= y1; ++y) {
+        const float* row = heights.readRow(y, c.x0, x1 - c.x0 + 1, buffer);
+        for (int x = 0; x <= x1 - c.x0; ++x) {
+            c.minZ = std::min(c.minZ, row[x]);
+            c.maxZ = std::max(c.maxZ, row[x]);
+        }
+    }
+}
+
+void TerrainQuadtree::computeChunk(const HeightFieldView& heights, TerrainChunk& c) const {
+    const int level = c.level;
+    const int childCells = cells(level - 1);
+    const int cx = c.x0 / c.extent();
+    const int cy = c.y0 / c.extent();
+
+    bool firstChild = true;
+    for (int dy = 0; dy < 2; ++dy) {
+        for (int dx = 0; dx < 2; ++dx) {
+            if (2 * cx + dx >= childCells || 2 * cy + dy >= childCells) {
+                continue;
+            }
+            const TerrainChunk& child = chunk(level - 1, 2 * cx + dx, 2 * cy + dy);
+            c.minZ = firstChild ? child.minZ : std::min(c.minZ, child.minZ);
+            c.maxZ = firstChild ? child.maxZ : std::max(c.maxZ, child.maxZ);
+            c.error = firstChild ? child.error : std::max(c.error, child.error);
+            firstChild = false;
+        }
+    }
+
+    /*
+        Points the child level has and this one drops are edge midpoints and quad centres.
+        Compare each with this level's triangles, split along the same diagonal the renderer uses.
+    */
+    const int step = c.step();
+    const int half = step / 2;
+    const int x1 = std::min(c.x0 + c.extent(), quads);
+    const int y1 = std::min(c.y0 + c.extent(), quads);
+    for (int gy = c.y0; gy < y1; gy += step) {
+        const int gy1 = std::min(gy + step, quads);
+        for (int gx = c.x0; gx < x1; gx += step) {
+            const int gx1 = std::min(gx + step, quads);
+            const float h00 = heights.at(gx, gy);
+            const float h10 = heights.at(gx1, gy);
+            const float h01 = heights.at(gx, gy1);
+            const float h11 = heights.at(gx1, gy1);
+
+            auto deviation = [&](int px, int py) {
+                const float u = static_cast<float>(px - gx) / (gx1 - gx);
+                const float v = static_cast<float>(py - gy) / (gy1 - gy);
+                const float plane = u + v <= 1.0f
+                    ? h00 + u * (h10 - h00) + v * (h01 - h00)
+                    : h11 + (1.0f - u) * (h01 - h11) + (1.0f - v) * (h10 - h11);
+                return std::abs(heights.at(px, py) - plane);
+            };
+
+            const int mx = gx + half;
+            const int my = gy + half;
+            const bool hasMx = mx < gx1;
+            const bool hasMy = my < gy1;
+            if (hasMx) {
+                c.error = std::max({ c.error, deviation(mx, gy), deviation(mx, gy1) });
+            }
+            if (hasMy) {
+                c.error = std::max({ c.error, deviation(gx, my), deviation(gx1, my) });
+            }
+            if (hasMx && hasMy) {
+                c.error = std::max(c.error, deviation(mx, my));
+            }
+        }
+    }
+}
+
+void TerrainQuadtree::recompute(const HeightFieldView& heights, int level, const std::vector<uint32_t>& cellIndices) {
+    std::vector<TerrainChunk>& chunks = levels[level];
+    WorkerPool::shared().parallelFor(cellIndices.size(), [&](size_t k) {
+        TerrainChunk& c = chunks[cellIndices[k]];
+        if (level == 0) {
+            computeLeaf(heights, c);
+        }
+        else {
+            computeChunk(heights, c);
+        }
+    });
+}
+
+void TerrainQuadtree::update(const HeightFieldView& heights, int x0, int y0, int x1, int y1, std::vector<uint32_t>& changed) {
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    x1 = std::min(x1, quads);
+    y1 = std::min(y1, quads);
+    if (empty() || x0 > x1 || y0 > y1) {
+        return;
+    }
+    std::vector<uint32_t> cellIndices;
+    for (int level = 0; level < getLevels(); ++level) {
+        // A point on a chunk boundary belongs to the chunks on both sides
+        const int extent = TerrainChunk::chunkQuads << level;
+        const int n = cells(level);
+        const int cx0 = x0 > 0 ? (x0 - 1) / extent : 0;
+        const int cy0 = y0 > 0 ? (y0 - 1) / extent : 0;
+        const int cx1 = std::min(x1 / extent, n - 1);
+        const int cy1 = std::min(y1 / extent, n - 1);
+        cellIndices.clear();
+        for (int cy = cy0; cy <= cy1; ++cy) {
+            for (int cx = cx0; cx <= cx1; ++cx) {
+                cellIndices.push_back(static_cast<uint32_t>(cy * n + cx));
+                changed.push_back(levels[level][cy * n + cx].index);
+            }
+        }
+        recompute(heights, level, cellIndices);
+    }
+}
+
+void TerrainQuadtree::scroll(const HeightFieldView& heights, int dx, int dy) {
+    std::vector<char> childMoved;
+    std::vector<uint32_t> cellIndices;
+    for (int level = 0; level < getLevels(); ++level) {
+        const int extent = TerrainChunk::chunkQuads << level;
+        const int n = cells(level);
+        const bool shifts = dx % extent == 0 && dy % extent == 0;
+        const std::vector<TerrainChunk> before = shifts ? levels[level] : std::vector<TerrainChunk>();
+        // Chunks cut by the map edge cover less than their extent, so their stats don't carry over
+        auto whole = [&](int cx, int cy) { return (cx + 1) * extent <= quads && (cy + 1) * extent <= quads; };
+
+        std::vector<char> moved(static_cast<size_t>(n) * n, 0);
+        cellIndices.clear();
+        for (int cy = 0; cy < n; ++cy) {
+            for (int cx = 0; cx < n; ++cx) {
+                const int sx = cx + dx / extent;
+                const int sy = cy + dy / extent;
+                bool keep = shifts && sx >= 0 && sy >= 0 && sx < n && sy < n && whole(cx, cy) && whole(sx, sy);
+                for (int k = 0; keep && level > 0 && k < 4; ++k) {
+                    const int childX = 2 * cx + (k & 1);
+                    const int childY = 2 * cy + (k >> 1);
+                    const int childCells = cells(level - 1);
+                    keep = childX >= childCells || childY >= childCells || childMoved[childY * childCells + childX];
+                }
+                TerrainChunk& c = levels[level][cy * n + cx];
+                if (keep) {
+                    const TerrainChunk& source = before[sy * n + sx];
+                    c.minZ = source.minZ;
+                    c.maxZ = source.maxZ;
+                    c.error = source.error;
+                    moved[cy * n + cx] = 1;
+                }
+                else {
+                    cellIndices.push_back(static_cast<uint32_t>(cy * n + cx));
+                }
+            }
+        }
+        recompute(heights, level, cellIndices);
+        childMoved.swap(moved);
+    }
+}
+
+size_t TerrainQuadtree::getChunkCount() const {
+    size_t count = 0;
+    for (const std::vector<TerrainChunk>& level : levels) {
+        count += level.size();
+    }
+    return count;
+}
+
+void quadNormals(int x0, int y0, int x1, int y1, const float h[4], int spacing, float out[6]) {
+    const float px0 = static_cast<float>(x0 * spacing);
+    const float py0 = static_cast<float>(y0 * spacing);
+    const float px1 = static_cast<float>(x1 * spacing);
+    const float py1 = static_cast<float>(y1 * spacing);
+
+    // normalize(cross(b - a, c - a)), falling back to straight up
+    auto face = [](const float a[3], const float b[3], const float c[3], float* n) {
+        const float u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        const float v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        const float x = u[1] * v[2] - v[1] * u[2];
+        const float y = u[2] * v[0] - v[2] * u[0];
+        const float z = u[0] * v[1] - v[0] * u[1];
+        const float scale = 1.0f / std::sqrt(x * x + y * y + z * z);
+        n[0] = x * scale;
+        n[1] = y * scale;
+        n[2] = z * scale;
+        if (!(std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]) >= 1e-6f)) {
+            n[0] = 0.0f;
+            n[1] = 0.0f;
+            n[2] = 1.0f;
+        }
+    };
+    const float p00[3] = { px0, py0, h[0] };
+    const float p10[3] = { px1, py0, h[1] };
+    const float p01[3] = { px0, py1, h[2] };
+    const float p11[3] = { px1, py1, h[3] };
+    face(p00, p10, p01, out);
+    face(p01, p10, p11, out + 3);
+}
+
+void TerrainSelection::select(const TerrainQuadtree& tree, const HeightFieldView& heights, const ChunkTest& visible, const ChunkTest& refine) {
+    this->heights = heights;
+    quads = tree.getQuads();
+    chunks.clear();
+    if (tree.empty()) {
+        cellsPerSide = 0;
+        cellLevel.clear();
+        return;
+    }
+    cellsPerSide = tree.cells(0);
+    cellLevel.assign(static_cast<size_t>(cellsPerSide) * cellsPerSide, 0);
+    visit(tree, tree.getLevels() - 1, 0, 0, visible, refine);
+}
+
+void TerrainSelection::visit(const TerrainQuadtree& tree, int level, int cx, int cy, const ChunkTest& visible, const ChunkTest& refine) {
+    const TerrainChunk& c = tree.chunk(level, cx, cy);
+    if (!visible(c)) {
+        markCells(level, cx, cy, culled);
+        return;
+    }
+    if (level > 0 && refine(c)) {
+        const int childCells = tree.cells(level - 1);
+        for (int dy = 0; dy < 2; ++dy) {
+            for (int dx = 0; dx < 2; ++dx) {
+                if (2 * cx + dx < childCells && 2 * cy + dy < childCells) {
+                    visit(tree, level - 1, 2 * cx + dx, 2 * cy + dy, visible, refine);
+                }
+            }
+        }
+        return;
+    }
+
+    chunks.push_back(&c);
+    markCells(level, cx, cy, static_cast<uint8_t>(level));
+}
+
+void TerrainSelection::markCells(int level, int cx, int cy, uint8_t value) {
+    const int cellX1 = std::min((cx + 1) << level, cellsPerSide);
+    const int cellY1 = std::min((cy + 1) << level, cellsPerSide);
+    for (int y = cy << level; y < cellY1; ++y) {
+        std::fill(cellLevel.begin() + y * cellsPerSide + (cx << level), cellLevel.begin() + y * cellsPerSide + cellX1, value);
+    }
+}
+
+int TerrainSelection::stitchStep(int across, int along, bool vertical) const {
+    constexpr int cellQuads = TerrainChunk::chunkQuads;
+    if (across % cellQuads != 0 || across <= 0 || across >= quads) {
+        return 0;
+    }
+    const int c1 = across / cellQuads;
+    const int c0 = c1 - 1;
+    int step = 0;
+    for (int r = along / cellQuads - (along % cellQuads == 0 ? 1 : 0); r <= along / cellQuads; ++r) {
+        if (r < 0 || r >= cellsPerSide) {
+            continue;
+        }
+        const uint8_t l0 = vertical ? cellLevel[r * cellsPerSide + c0] : cellLevel[c0 * cellsPerSide + r];
+        const uint8_t l1 = vertical ? cellLevel[r * cellsPerSide + c1] : cellLevel[c1 * cellsPerSide + r];
+        if (l0 != l1 && l0 != culled && l1 != culled) {
+            step = std::max({ step, 1 << l0, 1 << l1 });
+        }
+    }
+    return step;
+}
+
+/*
+    A chunk edge runs along a cell boundary where the cells on either side have different steps.
+    A point on such an edge that isn't on the coarser side's grid takes the height of the coarser
+    mesh there: linear between its two neighbouring coarse vertices, themselves stitched.
+    Each step of the recursion lands on a strictly coarser grid, so it ends within the tree depth.
+*/
+float TerrainSelection::stitchedHeight(int x, int y) const {
+    const int stepV = stitchStep(x, y, true);
+    if (stepV > 0 && y % stepV != 0 && y != quads) {
+        const int a = y - y % stepV;
+        const int b = std::min(a + stepV, quads);
+        const float t = static_cast<float>(y - a) / (b - a);
+        return stitchedHeight(x, a) * (1.0f - t) + stitchedHeight(x, b) * t;
+    }
+    const int stepH = stitchStep(y, x, false);
+    if (stepH > 0 && x % stepH != 0 && x != quads) {
+        const int a = x - x % stepH;
+        const int b = std::min(a + stepH, quads);
+        const float t = static_cast<float>(x - a) / (b - a);
+        return stitchedHeight(a, y) * (1.0f - t) + stitchedHeight(b, y) * t;
+    }
+    return heights.at(x, y);
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "heightfield.h"
+#include "functionref.h"
+#include <cstdint>
+#include <vector>
+
+/*
+	Square block of the height map drawn as one mesh.
+	A chunk at 'level' covers chunkQuads << level quads per side
+	and samples every (1 << level)-th height, so every chunk is at most 32 x 32 quads.
+	Coordinates are in height map points; the mesh is clamped to the map edge.
+*/
+struct TerrainChunk {
+	static constexpr int chunkQuads = 32;
+
+	int x0 = 0;
+	int y0 = 0;
+	int level = 0;
+	// Dense numbering over all levels, for per-chunk caches
+	uint32_t index = 0;
+	float minZ = 0;
+	float maxZ = 0;
+	// Largest height difference between this chunk's mesh and the full resolution one
+	float error = 0;
+
+	int step() const { return 1 << level; }
+	int extent() const { return chunkQuads << level; }
+};
+
+/*
+	Chunk pyramid over a height map, rebuilt whenever the heights change.
+	Level 0 is full resolution; each level up halves the sampling rate and doubles the
+	chunk extent, up to a single root chunk. Errors are accumulated bottom-up, so a chunk's
+	error bounds its whole subtree and refining never increases it.
+*/
+class TerrainQuadtree {
+private:
+	int quads = 0;
+	// levels[l] is a cells(l) x cells(l) grid, row-major
+	std::vector<std::vector<TerrainChunk>> levels;
+
+	void buildLeaves(const HeightFieldView& heights);
+	void buildLevel(const HeightFieldView& heights, int level);
+	// Stats of chunk c (position and level set) from the heights; levels above 0 also need its children
+	void computeLeaf(const HeightFieldView& heights, TerrainChunk& c) const;
+	void computeChunk(const HeightFieldView& heights, TerrainChunk& c) const;
+	void recompute(const HeightFieldView& heights, int level, const std::vector<uint32_t>& cellIndices);
+
+public:
+	/*
+		'quads' is the number of quads per side to cover, heights must hold quads + 1 points per side.
+	*/
+	void build(const HeightFieldView& heights, int quads);
+	/*
+		Recomputes the chunks covering points [x0; x1] x [y0; y1] after those heights changed,
+		appending their indices to 'changed'.
+	*/
+	void update(const HeightFieldView& heights, int x0, int y0, int x1, int y1, std::vector<uint32_t>& changed);
+	/*
+		Follows HeightField::scroll(dx, dy) of the heights: levels whose chunk extent divides
+		dx and dy move their stats along, everything else (the uncovered edge, higher levels)
+		is recomputed. Chunk indices stay with their position, not with the heights.
+	*/
+	void scroll(const HeightFieldView& heights, int dx, int dy);
+
+	int getQuads() const { return quads; }
+	int getLevels() const { return static_cast<int>(levels.size()); }
+	size_t getChunkCount() const;
+	int cells(int level) const { return (quads + (TerrainChunk::chunkQuads << level) - 1) / (TerrainChunk::chunkQuads << level); }
+	const TerrainChunk& chunk(int level, int cx, int cy) const { return levels[level][cy * cells(level) + cx]; }
+	bool empty() const { return levels.empty(); }
+};
+
+/*
+	Face normals of the quad (x0, y0) - (x1, y1), split like the renderer does:
+	(x0, y0) (x1, y0) (x0, y1), then (x0, y1) (x1, y0) (x1, y1).
+	h holds the heights at (x0, y0), (x1, y0), (x0, y1), (x1, y1); map points are 'spacing' apart.
+	Writes both unit normals to 'out', xyz each. Same arithmetic as glm::normalize(glm::cross()).
+*/
+void quadNormals(int x0, int y0, int x1, int y1, const float h[4], int spacing, float out[6]);
+
+/*
+	Set of chunks chosen for one view, plus crack stitching between them.
+	Where chunks of different levels meet, the finer side's edge vertices are moved
+	onto the coarser side's edge (height interpolated along it), so no gaps open.
+*/
+class TerrainSelection {
+private:
+	using ChunkTest = FunctionRef<bool(const TerrainChunk&)>;
+
+	// cellLevel of cells under a chunk rejected by the visibility test
+	static constexpr uint8_t culled = 0xFF;
+
+	HeightFieldView heights;
+	int quads = 0;
+	int cellsPerSide = 0;
+	// Level of the selected chunk covering each level-0 cell
+	std::vector<uint8_t> cellLevel;
+	std::vector<const TerrainChunk*> chunks;
+
+	void visit(const TerrainQuadtree& tree, int level, int cx, int cy, const ChunkTest& visible, const ChunkTest& refine);
+	void markCells(int level, int cx, int cy, uint8_t value);
+
+public:
+	/*
+		Walks the tree from the root. A chunk failing visible(chunk) is dropped with its whole
+		subtree; otherwise refine(chunk) decides whether to use the chunk's children instead.
+		'heights' must be the map the tree was built from.
+	*/
+	void select(const TerrainQuadtree& tree, const HeightFieldView& heights, const ChunkTest& visible, const ChunkTest& refine);
+
+	const std::vector<const TerrainChunk*>& getChunks() const { return chunks; }
+
+	/*
+		Height used for the mesh vertex at map point (x, y), stitched to coarser neighbours.
+		Interior chunk vertices can read the map directly.
+		Edges shared with culled chunks aren't stitched: they are outside the view.
+	*/
+	float stitchedHeight(int x, int y) const;
+	/*
+		Step of the coarser mesh along the chunk edge at 'across' (x = across when 'vertical',
+		else y = across) through point 'along' of it; 0 where the edge isn't stitched.
+	*/
+	int stitchStep(int across, int along, bool vertical) const;
+};
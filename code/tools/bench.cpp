@@ -0,0 +1,427 @@
+/*
+    fj-bench: fixed-seed benchmarks of every pipeline stage, no window needed.
+
+    fj-bench [options]
+        --out FILE        JSON results (default fj-bench.json)
+        --label TEXT      stored in the JSON, e.g. a release tag
+        --reps N          timed repetitions per case, the median is reported (default 3)
+        --tiles LIST      tile sizes to sweep, map is 10000 / tile quads across (default 100,50,20,10,5,2,1)
+        --quick           --tiles 100,50,20 and fewer noise samples
+
+    Stages:
+        noise       noise() and noise_batch(): ns/sample
+        generate    OctaveGenerator::generate over map sizes and octave counts: ns/sample,
+                    and generateBatch against one seed after another: maps/s
+        remap       Fjord::update with cached noise (applyMapType + LOD rebuild): ns/sample
+        quadtree    TerrainQuadtree::build alone: ns/sample
+        render      RenderEngine::renderFrame over map sizes and resolutions:
+                    triangles/s through setup (vertex transform), pixels/s through rasterization
+        raster      TileRasterizer on synthetic triangles of fixed area: triangles/s, pixels/s
+    Every case also records the process peak RSS so far.
+*/
+#include "render.h"
+#include "fjord.h"
+#include "generator.h"
+#include "noise.h"
+#include "raster.h"
+#include "terrain.h"
+#include "workers.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr int benchSeed = 4242;
+
+struct Options {
+    std::string outPath = "fj-bench.json";
+    std::string label;
+    int reps = 3;
+    std::vector<int> tiles = { 100, 50, 20, 10, 5, 2, 1 };
+    size_t noiseSamples = size_t(1) << 24;
+};
+
+struct Result {
+    std::string stage;
+    std::string variant;
+    std::vector<std::pair<std::string, double>> metrics;
+};
+
+size_t peakRssKb() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.PeakWorkingSetSize / 1024 : 0;
+#else
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss) / 1024;
+#else
+    return static_cast<size_t>(usage.ru_maxrss);
+#endif
+#endif
+}
+
+// Median wall time of 'reps' runs of 'run', in seconds
+template <typename F>
+double medianSeconds(int reps, F&& run) {
+    std::vector<double> times;
+    for (int r = 0; r < reps; ++r) {
+        const auto start = std::chrono::steady_clock::now();
+        run();
+        times.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+class Report {
+private:
+    std::vector<Result> results;
+
+public:
+    void add(const std::string& stage, const std::string& variant, std::vector<std::pair<std::string, double>> metrics) {
+        metrics.emplace_back("peak_rss_kb", static_cast<double>(peakRssKb()));
+        printf("%-9s %-28s", stage.c_str(), variant.c_str());
+        for (const auto& [name, value] : metrics) {
+            printf(" %s=%.4g", name.c_str(), value);
+        }
+        printf("\n");
+        fflush(stdout);
+        results.push_back({ stage, variant, std::move(metrics) });
+    }
+
+    bool write(const std::string& path, const Options& options) const {
+        FILE* file = fopen(path.c_str(), "w");
+        if (!file) {
+            return false;
+        }
+        char timestamp[32];
+        const std::time_t now = std::time(nullptr);
+        std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+        // Labels and stage names are plain ASCII, no escaping needed
+        fprintf(file, "{\n  \"version\": 1,\n  \"label\": \"%s\",\n  \"timestamp\": \"%s\",\n", options.label.c_str(), timestamp);
+        fprintf(file, "  \"threads\": %zu,\n  \"noise_isa\": \"%s\",\n  \"seed\": %d,\n  \"reps\": %d,\n",
+            WorkerPool::shared().getConcurrency(), noise_batch_isa(), benchSeed, options.reps);
+        fprintf(file, "  \"results\": [\n");
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result& result = results[i];
+            fprintf(file, "    { \"stage\": \"%s\", \"variant\": \"%s\"", result.stage.c_str(), result.variant.c_str());
+            for (const auto& [name, value] : result.metrics) {
+                fprintf(file, ", \"%s\": %.6g", name.c_str(), value);
+            }
+            fprintf(file, " }%s\n", i + 1 < results.size() ? "," : "");
+        }
+        fprintf(file, "  ]\n}\n");
+        return fclose(file) == 0;
+    }
+};
+
+std::string caseName(const char* format, int a, int b = 0) {
+    char name[64];
+    snprintf(name, sizeof(name), format, a, b);
+    return name;
+}
+
+void benchNoise(const Options& options, Report& report) {
+    // A 4096-wide grid of sample points in the range the generator uses
+    const size_t batch = 4096;
+    std::vector<float> xs(batch), ys(batch), out(batch);
+    for (size_t k = 0; k < batch; ++k) {
+        xs[k] = -0.5f + static_cast<float>(k) / batch;
+    }
+    const size_t rounds = std::max<size_t>(1, options.noiseSamples / batch);
+    volatile float sink = 0;
+
+    const double scalar = medianSeconds(options.reps, [&] {
+        float sum = 0;
+        for (size_t r = 0; r < rounds; ++r) {
+            const float y = 0.001f * r;
+            for (size_t k = 0; k < batch; ++k) {
+                sum += noise(xs[k], y);
+            }
+        }
+        sink = sum;
+    });
+    report.add("noise", "scalar", { { "ns_per_sample", scalar * 1e9 / (rounds * batch) } });
+
+    const double batched = medianSeconds(options.reps, [&] {
+        for (size_t r = 0; r < rounds; ++r) {
+            std::fill(ys.begin(), ys.end(), 0.001f * r);
+            noise_batch(xs.data(), ys.data(), out.data(), batch);
+        }
+        sink = out[0];
+    });
+    report.add("noise", std::string("batch-") + noise_batch_isa(), { { "ns_per_sample", batched * 1e9 / (rounds * batch) } });
+}
+
+void benchGenerate(const Options& options, Report& report) {
+    OctaveGenerator generator;
+    HeightField field;
+    auto run = [&](int tile, int octave) {
+        const size_t size = 10000 / tile;
+        generator.reconfigure(true, octave, benchSeed);
+        const double seconds = medianSeconds(options.reps, [&] { generator.generate(size, field); });
+        const double samples = static_cast<double>(size + 1) * (size + 1);
+        report.add("generate", caseName("tile%d-octave%d", tile, octave), {
+            { "points", samples },
+            { "ms", seconds * 1e3 },
+            { "ns_per_sample", seconds * 1e9 / samples },
+        });
+    };
+    for (int tile : options.tiles) {
+        run(tile, 8);
+    }
+    // Octave sweep at a mid-sized map; 12 takes the generic kernel
+    for (int octave : { 1, 2, 4, 8, 10, 12 }) {
+        run(10, octave);
+    }
+
+    // Many small maps, where a single map has too few tiles to fill the pool
+    const int tile = 20;
+    const size_t size = 10000 / tile;
+    std::vector<int> seeds;
+    for (int k = 0; k < 16; ++k) {
+        seeds.push_back(benchSeed + k);
+    }
+    const double sequential = medianSeconds(options.reps, [&] {
+        for (int seed : seeds) {
+            generator.reconfigure(true, 8, seed);
+            generator.generate(size, field);
+        }
+    });
+    generator.reconfigure(true, 8, benchSeed);
+    const double batched = medianSeconds(options.reps, [&] { generator.generateBatch(seeds, size); });
+    report.add("generate", caseName("batch%d-tile%d", static_cast<int>(seeds.size()), tile), {
+        { "maps", static_cast<double>(seeds.size()) },
+        { "sequential_ms", sequential * 1e3 },
+        { "ms", batched * 1e3 },
+        { "maps_per_s", seeds.size() / batched },
+    });
+}
+
+void benchRemap(const Options& options, Report& report) {
+    for (int tile : options.tiles) {
+        Fjord fjord(std::make_unique<OctaveGenerator>());
+        fjord.update(true, 8, benchSeed, 3000, tile);
+        const double samples = static_cast<double>(fjord.getSize() + 1) * (fjord.getSize() + 1);
+
+        for (bool quantized : { false, true }) {
+            fjord.setQuantized(quantized);
+            for (bool lake : { false, true }) {
+                // Elevation changes keep the noise cache, so only applyMapType() and the LOD rebuild run
+                int elevation = 3000;
+                const double seconds = medianSeconds(options.reps, [&] {
+                    elevation = elevation == 3000 ? 3001 : 3000;
+                    fjord.update(false, 8, benchSeed, elevation, tile, lake, 0.5f);
+                });
+                const char* format = lake ? (quantized ? "tile%d-lake-u16" : "tile%d-lake") : (quantized ? "tile%d-plain-u16" : "tile%d-plain");
+                report.add("remap", caseName(format, tile), {
+                    { "ms", seconds * 1e3 },
+                    { "ns_per_sample", seconds * 1e9 / samples },
+                });
+            }
+
+            TerrainQuadtree tree;
+            const double seconds = medianSeconds(options.reps, [&] { tree.build(fjord.getHeightMap(), fjord.getSize() - 1); });
+            report.add("quadtree", caseName(quantized ? "tile%d-u16" : "tile%d", tile), {
+                { "ms", seconds * 1e3 },
+                { "ns_per_sample", seconds * 1e9 / samples },
+            });
+        }
+    }
+}
+
+void benchRenderCase(RenderEngine& engine, int tile, int width, int height, const Options& options, Report& report, const char* suffix = "") {
+    // Medians per stage; a warm-up frame sizes the buffers first
+    engine.renderFrame(width, height);
+    std::vector<RenderEngine::FrameStats> frames;
+    const double seconds = medianSeconds(options.reps, [&] {
+        engine.renderFrame(width, height);
+        frames.push_back(engine.getFrameStats());
+    });
+    auto median = [&](double RenderEngine::FrameStats::*field) {
+        std::vector<double> values;
+        for (const RenderEngine::FrameStats& f : frames) {
+            values.push_back(f.*field);
+        }
+        std::sort(values.begin(), values.end());
+        return values[values.size() / 2];
+    };
+    const double setup = median(&RenderEngine::FrameStats::setupSeconds);
+    const double raster = median(&RenderEngine::FrameStats::rasterSeconds);
+    const double triangles = static_cast<double>(frames.back().triangles);
+    const double pixels = static_cast<double>(width) * height;
+
+    char name[64];
+    snprintf(name, sizeof(name), "tile%d-%dx%d%s", tile, width, height, suffix);
+    report.add("render", name, {
+        { "ms", seconds * 1e3 },
+        { "select_ms", median(&RenderEngine::FrameStats::selectSeconds) * 1e3 },
+        { "setup_ms", setup * 1e3 },
+        { "raster_ms", raster * 1e3 },
+        { "chunks", static_cast<double>(frames.back().chunks) },
+        { "triangles", triangles },
+        { "occluded_chunks", static_cast<double>(frames.back().occludedChunks) },
+        { "occluded_triangles", static_cast<double>(frames.back().occludedTriangles) },
+        { "allocations", static_cast<double>(frames.back().allocations) },
+        { "setup_triangles_per_s", setup > 0 ? triangles / setup : 0 },
+        { "raster_triangles_per_s", raster > 0 ? triangles / raster : 0 },
+        { "raster_pixels_per_s", raster > 0 ? pixels / raster : 0 },
+    });
+}
+
+void benchRender(const Options& options, Report& report) {
+    RenderEngine engine(std::make_unique<OctaveGenerator_Creator>());
+    for (int tile : options.tiles) {
+        engine.update(true, 8, benchSeed, 3000, tile);
+        benchRenderCase(engine, tile, 1920, 1080, options, report);
+    }
+    engine.update(true, 8, benchSeed, 3000, 20);
+    for (const auto& [width, height] : { std::pair<int, int>(640, 360), { 1280, 720 }, { 2560, 1440 }, { 3840, 2160 } }) {
+        benchRenderCase(engine, 20, width, height, options, report);
+    }
+    engine.setQuantized(true);
+    engine.update(true, 8, benchSeed, 3000, 20);
+    benchRenderCase(engine, 20, 1920, 1080, options, report, "-u16");
+}
+
+/*
+    Right triangles with legs of 'leg' pixels, scattered over a 1920x1080 target until
+    they cover it four times over, drawn in one frame.
+*/
+void benchRaster(const Options& options, Report& report) {
+    const int width = 1920;
+    const int height = 1080;
+    WorkerPool& pool = WorkerPool::shared();
+    FrameBuffer frame;
+    frame.resize(width, height);
+    TileRasterizer rasterizer;
+
+    for (int leg : { 2, 8, 32, 128 }) {
+        const double area = 0.5 * leg * leg;
+        const size_t count = static_cast<size_t>(4.0 * width * height / area);
+        std::mt19937 random(benchSeed);
+        std::uniform_real_distribution<float> px(0.0f, static_cast<float>(width - leg));
+        std::uniform_real_distribution<float> py(0.0f, static_cast<float>(height - leg));
+        std::uniform_real_distribution<float> depth(-1.0f, 1.0f);
+        std::uniform_int_distribution<int> channel(0, 255);
+
+        // One batch per 4096 triangles, like chunk setup jobs
+        std::vector<TriangleBatch> batches((count + 4095) / 4096);
+        for (size_t i = 0; i < count; ++i) {
+            ScreenTriangle t;
+            const float x = px(random);
+            const float y = py(random);
+            const float z = depth(random);
+            t.x[0] = x;
+            t.y[0] = y;
+            t.x[1] = x + leg;
+            t.y[1] = y;
+            t.x[2] = x;
+            t.y[2] = y + leg;
+            std::fill(t.z, t.z + 3, z);
+            t.color = ofColor(channel(random), channel(random), channel(random));
+            batches[i / 4096].push_back(t);
+        }
+
+        const double seconds = medianSeconds(options.reps, [&] {
+            frame.clear(ofColor(0, 0, 0));
+            rasterizer.begin(frame);
+            rasterizer.draw(batches.data(), batches.size(), frame, pool);
+        });
+        report.add("raster", caseName("leg%d-1920x1080", leg), {
+            { "triangles", static_cast<double>(count) },
+            { "ms", seconds * 1e3 },
+            { "triangles_per_s", count / seconds },
+            { "pixels_per_s", count * area / seconds },
+        });
+    }
+}
+
+std::vector<int> parseList(const std::string& value) {
+    std::vector<int> list;
+    std::stringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        const int v = atoi(item.c_str());
+        if (v >= 1 && v <= 10000) {
+            list.push_back(v);
+        }
+    }
+    return list;
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--quick") {
+            options.tiles = { 100, 50, 20 };
+            options.noiseSamples = size_t(1) << 20;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        const std::string value = argv[++i];
+        if (arg == "--out") {
+            options.outPath = value;
+        }
+        else if (arg == "--label") {
+            options.label = value;
+        }
+        else if (arg == "--reps") {
+            options.reps = std::max(1, atoi(value.c_str()));
+        }
+        else if (arg == "--tiles") {
+            options.tiles = parseList(value);
+        }
+        else {
+            return false;
+        }
+    }
+    return !options.tiles.empty();
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        fprintf(stderr, "usage: fj-bench [--out FILE] [--label TEXT] [--reps N] [--tiles 100,50,...] [--quick]\n");
+        return 2;
+    }
+
+    Report report;
+    benchNoise(options, report);
+    benchGenerate(options, report);
+    benchRemap(options, report);
+    benchRender(options, report);
+    benchRaster(options, report);
+
+    if (!report.write(options.outPath, options)) {
+        fprintf(stderr, "fj-bench: can't write %s\n", options.outPath.c_str());
+        return 1;
+    }
+    printf("results written to %s\n", options.outPath.c_str());
+    return 0;
+}
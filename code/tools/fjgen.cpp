@@ -0,0 +1,152 @@
+/*
+    fj-gen: headless batch generation, no window or GL context.
+
+    fj-gen [options]
+        --seeds FIRST:COUNT   seeds to generate (default 1:100)
+        --octave N            octave count (default 8)
+        --tile N              tile size, the map is 10000 / N quads across (default 20)
+        --elevation N         max elevation (default 3000)
+        --lake F              lake mode with water share F in [0; 1]
+        --format LIST         comma-separated: png, r16, pfm, obj, ply; none to only generate (default png)
+        --out DIR             output directory (default fj-gen-out)
+        --jobs N              maps generated at once (default: one per hardware thread)
+        --storage float|u16   height map storage, u16 halves its memory (default float)
+
+    Writes DIR/seed-<seed>.<format> for every seed and format,
+    then reports throughput in maps per second.
+*/
+#include "fjord.h"
+#include "workers.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Options {
+    int firstSeed = 1;
+    int count = 100;
+    int octave = 8;
+    int tileSize = 20;
+    int maxElevation = 3000;
+    bool isLake = false;
+    float waterPercentage = 0.5f;
+    std::vector<std::string> formats = { "png" };
+    std::string outDirectory = "fj-gen-out";
+    size_t jobs = 0;
+    bool quantized = false;
+};
+
+void usage() {
+    fprintf(stderr,
+        "usage: fj-gen [--seeds FIRST:COUNT] [--octave N] [--tile N] [--elevation N] [--lake F]\n"
+        "              [--format png,r16,pfm,obj,ply|none] [--out DIR] [--jobs N] [--storage float|u16]\n");
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        const std::string value = argv[++i];
+        if (arg == "--seeds") {
+            if (sscanf(value.c_str(), "%d:%d", &options.firstSeed, &options.count) != 2 || options.count < 0) {
+                return false;
+            }
+        }
+        else if (arg == "--octave") {
+            options.octave = atoi(value.c_str());
+        }
+        else if (arg == "--tile") {
+            options.tileSize = atoi(value.c_str());
+        }
+        else if (arg == "--elevation") {
+            options.maxElevation = atoi(value.c_str());
+        }
+        else if (arg == "--lake") {
+            options.isLake = true;
+            options.waterPercentage = static_cast<float>(atof(value.c_str()));
+        }
+        else if (arg == "--format") {
+            options.formats.clear();
+            std::stringstream list(value);
+            std::string format;
+            while (std::getline(list, format, ',')) {
+                if (format != "none") {
+                    options.formats.push_back(format);
+                }
+            }
+        }
+        else if (arg == "--out") {
+            options.outDirectory = value;
+        }
+        else if (arg == "--jobs") {
+            options.jobs = static_cast<size_t>(std::max(1, atoi(value.c_str())));
+        }
+        else if (arg == "--storage") {
+            if (value != "float" && value != "u16") {
+                return false;
+            }
+            options.quantized = value == "u16";
+        }
+        else {
+            return false;
+        }
+    }
+    return options.octave >= 1 && options.tileSize >= 1 && options.tileSize <= 10000;
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage();
+        return 2;
+    }
+    std::error_code error;
+    std::filesystem::create_directories(options.outDirectory, error);
+
+    /*
+        Each job owns a Fjord and pulls seeds until none are left. Generation inside a map
+        still goes through the shared pool, so a few large maps use every core as well.
+    */
+    WorkerPool& pool = WorkerPool::shared();
+    const size_t count = static_cast<size_t>(options.count);
+    const size_t jobs = std::min(count, options.jobs > 0 ? options.jobs : pool.getConcurrency());
+    std::atomic<size_t> next{ 0 };
+    std::atomic<size_t> failed{ 0 };
+
+    const auto start = std::chrono::steady_clock::now();
+    pool.parallelFor(jobs, [&](size_t) {
+        Fjord fjord(std::make_unique<OctaveGenerator>());
+        fjord.setQuantized(options.quantized);
+        for (size_t index = next++; index < count; index = next++) {
+            const int seed = options.firstSeed + static_cast<int>(index);
+            fjord.update(true, options.octave, seed, options.maxElevation, options.tileSize, options.isLake, options.waterPercentage);
+            for (const std::string& format : options.formats) {
+                const std::string path = (std::filesystem::path(options.outDirectory) / ("seed-" + std::to_string(seed) + "." + format)).string();
+                if (!fjord.exportTerrain(path)) {
+                    fprintf(stderr, "fj-gen: failed to write %s\n", path.c_str());
+                    ++failed;
+                }
+            }
+        }
+    });
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const int points = 10000 / options.tileSize + 1;
+    printf("%zu maps of %dx%d points in %.3f s with %zu jobs: %.2f maps/s, %.1f Mpoints/s\n",
+        count, points, points, seconds, jobs,
+        seconds > 0 ? count / seconds : 0.0,
+        seconds > 0 ? count * static_cast<double>(points) * points / seconds * 1e-6 : 0.0);
+    return failed > 0 ? 1 : 0;
+}
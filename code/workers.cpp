@@ -0,0 +1,93 @@
+#include "workers.h"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(size_t threads) {
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    for (size_t i = 1; i < threads; ++i) {
+        this->threads.emplace_back(&WorkerPool::workerLoop, this);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& t : threads) {
+        t.join();
+    }
+}
+
+void WorkerPool::Loop::run() {
+    for (size_t i = next++; i < count; i = next++) {
+        job(i);
+    }
+}
+
+void WorkerPool::workerLoop() {
+    for (;;) {
+        Loop* loop;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) {
+                return;
+            }
+            loop = queue.front();
+            queue.erase(queue.begin());
+            ++loop->attached;
+        }
+        loop->run();
+        // The caller may return as soon as the lock is released: no touching 'loop' after that
+        std::lock_guard<std::mutex> lock(loop->mutex);
+        --loop->attached;
+        loop->detached.notify_all();
+    }
+}
+
+void WorkerPool::parallelFor(size_t count, FunctionRef<void(size_t)> job) {
+    if (count == 0) {
+        return;
+    }
+    if (count == 1 || threads.empty()) {
+        for (size_t i = 0; i < count; ++i) {
+            job(i);
+        }
+        return;
+    }
+
+    /*
+        Helpers attach to the loop when they take it off the queue. Once the caller has run out
+        of indices it withdraws the entries nobody took, so no helper can attach any more,
+        and waits for the attached ones: they hold every index still running.
+    */
+    Loop loop(count, job);
+    const size_t helpers = std::min(threads.size(), count - 1);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.insert(queue.end(), helpers, &loop);
+    }
+    wake.notify_all();
+
+    loop.run();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.erase(std::remove(queue.begin(), queue.end(), &loop), queue.end());
+    }
+    std::unique_lock<std::mutex> lock(loop.mutex);
+    loop.detached.wait(lock, [&] { return loop.attached.load() == 0; });
+}
+
+size_t WorkerPool::getConcurrency() const {
+    return threads.size() + 1;
+}
+
+WorkerPool& WorkerPool::shared() {
+    static WorkerPool pool;
+    return pool;
+}
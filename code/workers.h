@@ -0,0 +1,60 @@
+#pragma once
+
+#include "functionref.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+	Fixed set of worker threads for data-parallel loops.
+	The thread calling parallelFor() works too, so nested calls can't deadlock.
+	A loop's state lives on its caller's stack and the queue keeps its capacity,
+	so parallelFor() doesn't touch the heap once warmed up.
+*/
+class WorkerPool {
+private:
+	struct Loop {
+		size_t count;
+		FunctionRef<void(size_t)> job;
+		std::atomic<size_t> next{ 0 };
+		// Helpers that took this loop off the queue and aren't done with it
+		std::atomic<size_t> attached{ 0 };
+		std::mutex mutex;
+		std::condition_variable detached;
+
+		Loop(size_t count, FunctionRef<void(size_t)> job) : count{ count }, job{ job } {}
+		void run();
+	};
+
+	std::vector<std::thread> threads;
+	// One entry per helper a loop asked for, oldest first
+	std::vector<Loop*> queue;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping = false;
+
+	void workerLoop();
+
+public:
+	/*
+		'threads' = 0 means one per hardware thread (the caller counts as one of them).
+	*/
+	explicit WorkerPool(size_t threads = 0);
+	~WorkerPool();
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	/*
+		Runs job(index) for every index in [0; count) and returns when all are done.
+		Indices are handed out dynamically, so jobs must not depend on execution order.
+	*/
+	void parallelFor(size_t count, FunctionRef<void(size_t)> job);
+
+	// Number of threads that can run jobs at once, caller included
+	size_t getConcurrency() const;
+
+	static WorkerPool& shared();
+};